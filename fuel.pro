@@ -16,7 +16,13 @@ SOURCES += src/main.cpp\
 	src/Utils.cpp \
 	src/FileTableView.cpp \
 	src/CloneDialog.cpp \
-	src/LoggedProcess.cpp
+	src/LoggedProcess.cpp \
+	src/FileTableModel.cpp \
+	src/DirTreeModel.cpp \
+	src/WorkspaceScanner.cpp \
+	src/GlobMatcher.cpp \
+	src/LogConsole.cpp \
+	src/FileTable.cpp
 
 HEADERS  += src/MainWindow.h \
 	src/CommitDialog.h \
@@ -25,7 +31,13 @@ HEADERS  += src/MainWindow.h \
 	src/Utils.h \
 	src/FileTableView.h \
 	src/CloneDialog.h \
-	src/LoggedProcess.h
+	src/LoggedProcess.h \
+	src/FileTableModel.h \
+	src/DirTreeModel.h \
+	src/WorkspaceScanner.h \
+	src/GlobMatcher.h \
+	src/LogConsole.h \
+	src/FileTable.h
 
 FORMS    += ui/MainWindow.ui \
 	ui/CommitDialog.ui \
@@ -0,0 +1,307 @@
+#include "DirTreeModel.h"
+#include <QStringList>
+
+///////////////////////////////////////////////////////////////////////////////
+DirTreeModel::DirTreeModel(QObject *parent) :
+	QAbstractItemModel(parent),
+	folderIcon(":icons/icons/Folder-01.png"),
+	projectIcon(":icons/icons/My Documents-01.png")
+{
+	root = new DirNode(0, "", "");
+	root->Fetched = true;
+	project = new DirNode(root, "", "");
+	root->Children.append(project);
+}
+
+//------------------------------------------------------------------------------
+DirTreeModel::~DirTreeModel()
+{
+	delete root;
+}
+
+//------------------------------------------------------------------------------
+void DirTreeModel::setRootName(const QString &name)
+{
+	if(project->Name == name)
+		return;
+
+	project->Name = name;
+	QModelIndex index = getIndex(project);
+	emit dataChanged(index, index);
+}
+
+//------------------------------------------------------------------------------
+void DirTreeModel::clear()
+{
+	beginResetModel();
+	qDeleteAll(project->Children);
+	project->Children.clear();
+	project->Fetched = false;
+	endResetModel();
+}
+
+//------------------------------------------------------------------------------
+// Make the tree contain exactly the given paths and their parents.
+// Folders that exist already are kept, along with their expansion and
+// selection state in the view.
+void DirTreeModel::setPaths(const QSet<QString> &paths)
+{
+	if(project->Children.isEmpty())
+	{
+		// Nothing to preserve, so build the tree in one go
+		beginResetModel();
+		project->Fetched = false;
+		for(QSet<QString>::const_iterator it=paths.begin(); it!=paths.end(); ++it)
+			insertPath(*it, false);
+		endResetModel();
+		return;
+	}
+
+	unmark(project);
+	for(QSet<QString>::const_iterator it=paths.begin(); it!=paths.end(); ++it)
+		insertPath(*it, true);
+	removeUnmarked(project);
+}
+
+//------------------------------------------------------------------------------
+void DirTreeModel::addPath(const QString &path)
+{
+	insertPath(path, true);
+}
+
+//------------------------------------------------------------------------------
+// Locate the child of node called name. Returns its row if found,
+// otherwise the row at which it should be inserted
+int DirTreeModel::findChild(const DirNode *node, const QString &name, bool &found) const
+{
+	int lo = 0;
+	int hi = node->Children.size();
+	while(lo<hi)
+	{
+		int mid = (lo+hi)/2;
+		int c = QString::compare(node->Children[mid]->Name, name);
+		if(c==0)
+		{
+			found = true;
+			return mid;
+		}
+		if(c<0)
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+	found = false;
+	return lo;
+}
+
+//------------------------------------------------------------------------------
+int DirTreeModel::getRow(const DirNode *node) const
+{
+	bool found = false;
+	int row = findChild(node->Parent, node->Name, found);
+	Q_ASSERT(found);
+	return row;
+}
+
+//------------------------------------------------------------------------------
+void DirTreeModel::insertPath(const QString &path, bool notify)
+{
+	if(path.isEmpty())
+		return;
+
+	QStringList dirs = path.split('/');
+	DirNode *node = project;
+
+	int d = 0;
+	int row = 0;
+	for(; d<dirs.size(); ++d)
+	{
+		bool found = false;
+		row = findChild(node, dirs[d], found);
+		if(!found)
+			break;
+
+		node = node->Children[row];
+		node->Marked = true;
+	}
+
+	// The whole path is in the tree already
+	if(d==dirs.size())
+		return;
+
+	// Build the missing part of the path as a chain before the view sees
+	// it, so that a single row insertion covers all of it
+	QString fullpath = dirs.mid(0, d+1).join("/");
+	DirNode *top = new DirNode(node, dirs[d], fullpath);
+	DirNode *last = top;
+	for(++d; d<dirs.size(); ++d)
+	{
+		fullpath += '/' + dirs[d];
+		DirNode *child = new DirNode(last, dirs[d], fullpath);
+		last->Children.append(child);
+		last = child;
+	}
+
+	// A visible folder without children has nothing left to fetch, so
+	// its first child must be announced to the view
+	if(notify && !node->Fetched && node->Children.isEmpty() && node->Parent->Fetched)
+		node->Fetched = true;
+
+	if(notify && node->Fetched)
+	{
+		beginInsertRows(getIndex(node), row, row);
+		node->Children.insert(row, top);
+		endInsertRows();
+	}
+	else
+		node->Children.insert(row, top);
+}
+
+//------------------------------------------------------------------------------
+void DirTreeModel::unmark(DirNode *node)
+{
+	for(int i=0; i<node->Children.size(); ++i)
+	{
+		node->Children[i]->Marked = false;
+		unmark(node->Children[i]);
+	}
+}
+
+//------------------------------------------------------------------------------
+void DirTreeModel::removeUnmarked(DirNode *node)
+{
+	for(int i=node->Children.size()-1; i>=0; --i)
+	{
+		DirNode *child = node->Children[i];
+		if(child->Marked)
+		{
+			removeUnmarked(child);
+			continue;
+		}
+
+		if(node->Fetched)
+			beginRemoveRows(getIndex(node), i, i);
+		node->Children.remove(i);
+		if(node->Fetched)
+			endRemoveRows();
+		delete child;
+	}
+}
+
+//------------------------------------------------------------------------------
+DirTreeModel::DirNode *DirTreeModel::getNode(const QModelIndex &index) const
+{
+	if(!index.isValid())
+		return root;
+	return static_cast<DirNode*>(index.internalPointer());
+}
+
+//------------------------------------------------------------------------------
+QModelIndex DirTreeModel::getIndex(DirNode *node) const
+{
+	if(node==root)
+		return QModelIndex();
+	return createIndex(getRow(node), 0, node);
+}
+
+//------------------------------------------------------------------------------
+QModelIndex DirTreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+	if(column!=0 || row<0 || row>=rowCount(parent))
+		return QModelIndex();
+
+	DirNode *node = getNode(parent);
+	return createIndex(row, column, node->Children[row]);
+}
+
+//------------------------------------------------------------------------------
+QModelIndex DirTreeModel::parent(const QModelIndex &index) const
+{
+	if(!index.isValid())
+		return QModelIndex();
+
+	return getIndex(getNode(index)->Parent);
+}
+
+//------------------------------------------------------------------------------
+int DirTreeModel::rowCount(const QModelIndex &parent) const
+{
+	if(parent.column()>0)
+		return 0;
+
+	const DirNode *node = getNode(parent);
+	return node->Fetched ? node->Children.size() : 0;
+}
+
+//------------------------------------------------------------------------------
+int DirTreeModel::columnCount(const QModelIndex &/*parent*/) const
+{
+	return 1;
+}
+
+//------------------------------------------------------------------------------
+bool DirTreeModel::hasChildren(const QModelIndex &parent) const
+{
+	return !getNode(parent)->Children.isEmpty();
+}
+
+//------------------------------------------------------------------------------
+bool DirTreeModel::canFetchMore(const QModelIndex &parent) const
+{
+	const DirNode *node = getNode(parent);
+	return !node->Fetched && !node->Children.isEmpty();
+}
+
+//------------------------------------------------------------------------------
+void DirTreeModel::fetchMore(const QModelIndex &parent)
+{
+	DirNode *node = getNode(parent);
+	if(node->Fetched)
+		return;
+
+	if(node->Children.isEmpty())
+	{
+		node->Fetched = true;
+		return;
+	}
+
+	beginInsertRows(parent, 0, node->Children.size()-1);
+	node->Fetched = true;
+	endInsertRows();
+}
+
+//------------------------------------------------------------------------------
+QVariant DirTreeModel::data(const QModelIndex &index, int role) const
+{
+	if(!index.isValid())
+		return QVariant();
+
+	const DirNode *node = getNode(index);
+
+	switch(role)
+	{
+	case Qt::DisplayRole:
+		return node->Name;
+	case Qt::DecorationRole:
+		return node==project ? projectIcon : folderIcon;
+	case ROLE_PATH:
+		return node->Path;
+	}
+	return QVariant();
+}
+
+//------------------------------------------------------------------------------
+QVariant DirTreeModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if(section==0 && orientation==Qt::Horizontal && role==Qt::DisplayRole)
+		return tr("Folders");
+	return QVariant();
+}
+
+//------------------------------------------------------------------------------
+Qt::ItemFlags DirTreeModel::flags(const QModelIndex &index) const
+{
+	if(!index.isValid())
+		return 0;
+	return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+}
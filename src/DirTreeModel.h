@@ -0,0 +1,74 @@
+#ifndef DIRTREEMODEL_H
+#define DIRTREEMODEL_H
+
+#include <QAbstractItemModel>
+#include <QVector>
+#include <QIcon>
+#include <QSet>
+
+//////////////////////////////////////////////////////////////////////////
+// DirTreeModel
+// The folder tree of the workspace. Directories are kept in a prefix
+// tree with one node per path component and the children of each node
+// sorted by name, so a path is located with one binary search per
+// component. The view only sees the children of a node once it is
+// expanded (see fetchMore).
+//////////////////////////////////////////////////////////////////////////
+class DirTreeModel : public QAbstractItemModel
+{
+	Q_OBJECT
+public:
+	enum Role
+	{
+		ROLE_PATH	= Qt::UserRole+1	// Workspace-relative path of the folder
+	};
+
+	explicit DirTreeModel(QObject *parent = 0);
+	~DirTreeModel();
+
+	void setRootName(const QString &name);
+	void setPaths(const QSet<QString> &paths);
+	void addPath(const QString &path);
+	void clear();
+
+	QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+	QModelIndex parent(const QModelIndex &index) const;
+	int rowCount(const QModelIndex &parent = QModelIndex()) const;
+	int columnCount(const QModelIndex &parent = QModelIndex()) const;
+	bool hasChildren(const QModelIndex &parent = QModelIndex()) const;
+	bool canFetchMore(const QModelIndex &parent) const;
+	void fetchMore(const QModelIndex &parent);
+	QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+	Qt::ItemFlags flags(const QModelIndex &index) const;
+
+private:
+	struct DirNode
+	{
+		DirNode(DirNode *parent, const QString &name, const QString &path)
+			: Parent(parent), Name(name), Path(path), Fetched(false), Marked(true) {}
+		~DirNode() { qDeleteAll(Children); }
+
+		DirNode				*Parent;
+		QString				Name;
+		QString				Path;
+		QVector<DirNode*>	Children;	// Sorted by Name
+		bool				Fetched;	// True once the view has seen the children
+		bool				Marked;		// Used by setPaths() to detect stale nodes
+	};
+
+	DirNode *getNode(const QModelIndex &index) const;
+	QModelIndex getIndex(DirNode *node) const;
+	int findChild(const DirNode *node, const QString &name, bool &found) const;
+	int getRow(const DirNode *node) const;
+	void insertPath(const QString &path, bool notify);
+	void unmark(DirNode *node);
+	void removeUnmarked(DirNode *node);
+
+	DirNode			*root;		// Invisible node holding the project node
+	DirNode			*project;	// The workspace root, path ""
+	QIcon			folderIcon;
+	QIcon			projectIcon;
+};
+
+#endif // DIRTREEMODEL_H
@@ -0,0 +1,316 @@
+#include "FileTable.h"
+#include <QtAlgorithms>
+
+#define PATH_SEP			"/"
+
+//------------------------------------------------------------------------------
+// Order folder paths so that each folder is directly followed by all of
+// its subfolders. This is plain string order, except that '/' comes
+// before any other character
+static bool DirLess(const QString &a, const QString &b)
+{
+	int n = qMin(a.length(), b.length());
+	for(int i=0; i<n; ++i)
+	{
+		QChar ca = a[i];
+		QChar cb = b[i];
+		if(ca==cb)
+			continue;
+		if(ca=='/')
+			return true;
+		if(cb=='/')
+			return false;
+		return ca < cb;
+	}
+	return a.length() < b.length();
+}
+
+//------------------------------------------------------------------------------
+static uint HashPath(const QString &dir, const QString &name)
+{
+	return qHash(dir)*31 + qHash(name);
+}
+
+//------------------------------------------------------------------------------
+struct DirIdLess
+{
+	DirIdLess(const QStringList &dirs) : dirs(dirs) {}
+	bool operator()(int a, int b) const
+	{
+		return DirLess(dirs[a], dirs[b]);
+	}
+	const QStringList &dirs;
+};
+
+//------------------------------------------------------------------------------
+struct RowLess
+{
+	RowLess(const QVector<int> &dirRanks, const QVector<int> &dirIds, const QVector<QString> &names)
+		: dirRanks(dirRanks), dirIds(dirIds), names(names) {}
+	bool operator()(int a, int b) const
+	{
+		int ra = dirRanks[dirIds[a]];
+		int rb = dirRanks[dirIds[b]];
+		if(ra!=rb)
+			return ra < rb;
+		return names[a] < names[b];
+	}
+	const QVector<int> &dirRanks;
+	const QVector<int> &dirIds;
+	const QVector<QString> &names;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+FileTable::FileTable(const QString &workspace) :
+	workspace(workspace),
+	sorted(false)
+{
+}
+
+//------------------------------------------------------------------------------
+void FileTable::clear()
+{
+	names.clear();
+	dirIds.clear();
+	types.clear();
+	hashes.clear();
+	mtimes.clear();
+	dirs.clear();
+	dirIndex.clear();
+	buckets.clear();
+	sorted = false;
+	sortedRows.clear();
+	sortedDirs.clear();
+	dirRanks.clear();
+	rankStart.clear();
+}
+
+//------------------------------------------------------------------------------
+int FileTable::internDir(const QString &dir)
+{
+	QHash<QString, int>::const_iterator it = dirIndex.find(dir);
+	if(it!=dirIndex.end())
+		return *it;
+
+	int id = dirs.size();
+	dirs.append(dir);
+	dirIndex.insert(dir, id);
+	return id;
+}
+
+//------------------------------------------------------------------------------
+RepoFile FileTable::add(const QString &dir, const QString &name, RepoFile::EntryType type)
+{
+	uint hash = HashPath(dir, name);
+
+	// A file added twice keeps its row
+	int row = findRow(dir, name, hash);
+	if(row!=-1)
+	{
+		types[row] = quint8(type);
+		return at(row);
+	}
+
+	row = size();
+	names.append(name);
+	dirIds.append(internDir(dir));
+	types.append(quint8(type));
+	hashes.append(hash);
+	mtimes.append(MTIME_UNKNOWN);
+	sorted = false;
+
+	// Keep the index at most half full
+	if(size()*2 > buckets.size())
+		rehash(qMax<int>(MIN_BUCKETS, buckets.size()*2));
+	else
+		insertIndex(row);
+
+	return at(row);
+}
+
+//------------------------------------------------------------------------------
+void FileTable::insertIndex(int row)
+{
+	int mask = buckets.size()-1;
+	int b = hashes[row] & mask;
+	while(buckets[b])
+		b = (b+1) & mask;
+	buckets[b] = row+1;
+}
+
+//------------------------------------------------------------------------------
+void FileTable::rehash(int bucketCount)
+{
+	buckets.fill(0, bucketCount);
+	for(int row=0; row<size(); ++row)
+		insertIndex(row);
+}
+
+//------------------------------------------------------------------------------
+int FileTable::findRow(const QString &dir, const QString &name, uint hash) const
+{
+	if(buckets.empty())
+		return -1;
+
+	int mask = buckets.size()-1;
+	for(int b = hash & mask; buckets[b]; b = (b+1) & mask)
+	{
+		int row = buckets[b]-1;
+		if(hashes[row]==hash && names[row]==name && dirs[dirIds[row]]==dir)
+			return row;
+	}
+	return -1;
+}
+
+//------------------------------------------------------------------------------
+RepoFile FileTable::find(const QString &filePath) const
+{
+	int sep = filePath.lastIndexOf(PATH_SEP);
+	QString dir = sep==-1 ? QString("") : filePath.left(sep);
+	QString name = filePath.mid(sep+1);
+
+	int row = findRow(dir, name, HashPath(dir, name));
+	return row==-1 ? RepoFile() : at(row);
+}
+
+//------------------------------------------------------------------------------
+QString FileTable::getFilePath(int row) const
+{
+	const QString &dir = dirs[dirIds[row]];
+	if(dir.isEmpty())
+		return names[row];
+	return dir + PATH_SEP + names[row];
+}
+
+//------------------------------------------------------------------------------
+QString FileTable::getSuffix(int row) const
+{
+	// Same as QFileInfo::suffix()
+	const QString &name = names[row];
+	int dot = name.lastIndexOf('.');
+	if(dot==-1)
+		return QString("");
+	return name.mid(dot+1);
+}
+
+//------------------------------------------------------------------------------
+QDateTime FileTable::getLastModified(int row) const
+{
+	qint64 &mtime = mtimes[row];
+	if(mtime==MTIME_UNKNOWN)
+	{
+		QDateTime dt = QFileInfo(workspace + PATH_SEP + getFilePath(row)).lastModified();
+		mtime = dt.isValid() ? dt.toMSecsSinceEpoch() : qint64(MTIME_NONE);
+	}
+
+	if(mtime==MTIME_NONE)
+		return QDateTime();
+	return QDateTime::fromMSecsSinceEpoch(mtime);
+}
+
+//------------------------------------------------------------------------------
+void FileTable::sort()
+{
+	int num_dirs = dirs.size();
+
+	sortedDirs.resize(num_dirs);
+	for(int i=0; i<num_dirs; ++i)
+		sortedDirs[i] = i;
+	qSort(sortedDirs.begin(), sortedDirs.end(), DirIdLess(dirs));
+
+	dirRanks.resize(num_dirs);
+	for(int r=0; r<num_dirs; ++r)
+		dirRanks[sortedDirs[r]] = r;
+
+	sortedRows.resize(size());
+	for(int row=0; row<size(); ++row)
+		sortedRows[row] = row;
+	qSort(sortedRows.begin(), sortedRows.end(), RowLess(dirRanks, dirIds, names));
+
+	// Count the files of each rank, then turn the counts into offsets
+	rankStart.fill(0, num_dirs+1);
+	for(int row=0; row<size(); ++row)
+		++rankStart[dirRanks[dirIds[row]]+1];
+	for(int r=0; r<num_dirs; ++r)
+		rankStart[r+1] += rankStart[r];
+
+	sorted = true;
+}
+
+//------------------------------------------------------------------------------
+// Find the ranks of dir and all its subfolders, which are consecutive
+void FileTable::getSubtreeRanks(const QString &dir, int &first, int &last) const
+{
+	int lo = 0;
+	int hi = sortedDirs.size();
+	while(lo<hi)
+	{
+		int mid = (lo+hi)/2;
+		if(DirLess(dirs[sortedDirs[mid]], dir))
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+
+	// An empty path is the root folder, so it includes all folders
+	QString prefix = dir + PATH_SEP;
+	first = last = lo;
+	while(last<sortedDirs.size())
+	{
+		const QString &d = dirs[sortedDirs[last]];
+		if(!dir.isEmpty() && d!=dir && !d.startsWith(prefix))
+			break;
+		++last;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Append the files directly in dir
+void FileTable::getDirFiles(const QString &dir, QVector<RepoFile> &files) const
+{
+	QHash<QString, int>::const_iterator it = dirIndex.find(dir);
+	if(it==dirIndex.end())
+		return;
+	int id = *it;
+
+	if(sorted)
+	{
+		int rank = dirRanks[id];
+		for(int i=rankStart[rank]; i<rankStart[rank+1]; ++i)
+			files.append(at(sortedRows[i]));
+		return;
+	}
+
+	// While a scan is still adding files, check every row
+	for(int row=0; row<size(); ++row)
+	{
+		if(dirIds[row]==id)
+			files.append(at(row));
+	}
+}
+
+//------------------------------------------------------------------------------
+// Append all files in dir and its subfolders
+void FileTable::getSubtreeFiles(const QString &dir, QVector<RepoFile> &files) const
+{
+	if(sorted)
+	{
+		int first, last;
+		getSubtreeRanks(dir, first, last);
+		for(int i=rankStart[first]; i<rankStart[last]; ++i)
+			files.append(at(sortedRows[i]));
+		return;
+	}
+
+	// While a scan is still adding files, decide once per folder
+	QString prefix = dir + PATH_SEP;
+	QVector<bool> in_subtree(dirs.size());
+	for(int id=0; id<dirs.size(); ++id)
+		in_subtree[id] = dir.isEmpty() || dirs[id]==dir || dirs[id].startsWith(prefix);
+
+	for(int row=0; row<size(); ++row)
+	{
+		if(in_subtree[dirIds[row]])
+			files.append(at(row));
+	}
+}
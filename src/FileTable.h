@@ -0,0 +1,196 @@
+#ifndef FILETABLE_H
+#define FILETABLE_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QDateTime>
+#include <QFileInfo>
+
+class FileTable;
+
+//////////////////////////////////////////////////////////////////////////
+// RepoFile
+// A reference to one file of a FileTable. It is only valid as long as
+// the table is not cleared.
+//////////////////////////////////////////////////////////////////////////
+class RepoFile
+{
+public:
+	enum EntryType
+	{
+		TYPE_UNKNOWN		= 1<<0,
+		TYPE_UNCHANGED		= 1<<1,
+		TYPE_EDITTED		= 1<<2,
+		TYPE_ADDED			= 1<<3,
+		TYPE_DELETED		= 1<<4,
+		TYPE_MISSING		= 1<<5,
+		TYPE_RENAMED		= 1<<6,
+		TYPE_MODIFIED		= TYPE_EDITTED|TYPE_ADDED|TYPE_DELETED|TYPE_MISSING|TYPE_RENAMED,
+		TYPE_REPO			= TYPE_UNCHANGED|TYPE_MODIFIED,
+		TYPE_ALL			= TYPE_UNKNOWN|TYPE_REPO
+	};
+
+	RepoFile() : table(0), row(-1) {}
+	RepoFile(const FileTable *table, int row) : table(table), row(row) {}
+
+	bool isValid() const
+	{
+		return table!=0;
+	}
+
+	int getRow() const
+	{
+		return row;
+	}
+
+	EntryType getType() const;
+
+	bool isType(EntryType t) const
+	{
+		return getType() == t;
+	}
+
+	bool isRepo() const
+	{
+		EntryType t = getType();
+		return t == TYPE_UNCHANGED || t == TYPE_EDITTED;
+	}
+
+	QString getFilePath() const;
+	const QString &getFilename() const;
+	const QString &getPath() const;
+	QString getSuffix() const;
+	QFileInfo getFileInfo() const;
+	QDateTime getLastModified() const;
+
+private:
+	const FileTable	*table;
+	int				row;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// FileTable
+// The files of a workspace, stored column by column. A file costs its
+// name, an id into a table of interned directory paths, its type and a
+// few integers of index, rather than a heap object with a QFileInfo and
+// two more path strings. Modification times are only read from disk
+// the first time they are asked for.
+// Files are found by path through an open addressing hash. Once sort()
+// has been called the files of any folder, or of a folder along with
+// all its subfolders, form a single contiguous range of the sort order.
+//////////////////////////////////////////////////////////////////////////
+class FileTable
+{
+public:
+	explicit FileTable(const QString &workspace = QString());
+
+	void setWorkspace(const QString &workspace) { this->workspace = workspace; }
+	const QString &getWorkspace() const { return workspace; }
+	void clear();
+
+	RepoFile add(const QString &dir, const QString &name, RepoFile::EntryType type);
+	RepoFile find(const QString &filePath) const;
+	void sort();
+
+	int size() const { return types.size(); }
+	RepoFile at(int row) const { return RepoFile(this, row); }
+
+	RepoFile::EntryType getType(int row) const { return RepoFile::EntryType(types[row]); }
+	const QString &getFilename(int row) const { return names[row]; }
+	const QString &getPath(int row) const { return dirs[dirIds[row]]; }
+	QString getFilePath(int row) const;
+	QString getSuffix(int row) const;
+	QDateTime getLastModified(int row) const;
+
+	int dirCount() const { return dirs.size(); }
+	const QString &getDir(int id) const { return dirs[id]; }
+	bool containsDir(const QString &dir) const { return dirIndex.contains(dir); }
+	QSet<QString> getDirSet() const { return dirs.toSet(); }
+
+	void getDirFiles(const QString &dir, QVector<RepoFile> &files) const;
+	void getSubtreeFiles(const QString &dir, QVector<RepoFile> &files) const;
+
+private:
+	int internDir(const QString &dir);
+	int findRow(const QString &dir, const QString &name, uint hash) const;
+	void insertIndex(int row);
+	void rehash(int bucketCount);
+	void getSubtreeRanks(const QString &dir, int &first, int &last) const;
+
+	enum
+	{
+		MIN_BUCKETS		= 256,	// Must be a power of 2
+		MTIME_UNKNOWN	= -1,	// Not read from disk yet
+		MTIME_NONE		= -2	// The file has no modification time
+	};
+
+	QString					workspace;
+
+	// One entry per file
+	QVector<QString>		names;		// Name without the directory
+	QVector<int>			dirIds;		// Index into dirs
+	QVector<quint8>			types;		// RepoFile::EntryType
+	QVector<uint>			hashes;		// Hash of the path
+	mutable QVector<qint64>	mtimes;		// Msecs since the epoch or MTIME_*
+
+	// Interned directories
+	QStringList				dirs;		// Workspace-relative paths. The root is ""
+	QHash<QString, int>		dirIndex;	// Path to index into dirs
+
+	// Path index. Each bucket holds a row+1, or 0 if empty
+	QVector<int>			buckets;
+
+	// Sort order, valid while sorted is true
+	bool					sorted;
+	QVector<int>			sortedRows;	// Rows ordered by folder, then by name
+	QVector<int>			sortedDirs;	// Directory ids in sort order
+	QVector<int>			dirRanks;	// Position of each directory in sortedDirs
+	QVector<int>			rankStart;	// First position in sortedRows of each rank
+};
+
+//------------------------------------------------------------------------------
+inline RepoFile::EntryType RepoFile::getType() const
+{
+	return table->getType(row);
+}
+
+//------------------------------------------------------------------------------
+inline QString RepoFile::getFilePath() const
+{
+	return table->getFilePath(row);
+}
+
+//------------------------------------------------------------------------------
+inline const QString &RepoFile::getFilename() const
+{
+	return table->getFilename(row);
+}
+
+//------------------------------------------------------------------------------
+inline const QString &RepoFile::getPath() const
+{
+	return table->getPath(row);
+}
+
+//------------------------------------------------------------------------------
+inline QString RepoFile::getSuffix() const
+{
+	return table->getSuffix(row);
+}
+
+//------------------------------------------------------------------------------
+inline QFileInfo RepoFile::getFileInfo() const
+{
+	return QFileInfo(table->getWorkspace() + "/" + getFilePath());
+}
+
+//------------------------------------------------------------------------------
+inline QDateTime RepoFile::getLastModified() const
+{
+	return table->getLastModified(row);
+}
+
+#endif // FILETABLE_H
@@ -0,0 +1,189 @@
+#include "FileTableModel.h"
+#include <QDateTime>
+#include <QDir>
+
+#define COUNTOF(array) (sizeof(array)/sizeof(array[0]))
+
+//-----------------------------------------------------------------------------
+static const struct { RepoFile::EntryType type; const char *tag; const char *tooltip; const char *icon; }
+stats[] =
+{
+	{   RepoFile::TYPE_EDITTED, "E", "Edited", ":icons/icons/Button Blank Yellow-01.png" },
+	{   RepoFile::TYPE_UNCHANGED, "U", "Unchanged", ":icons/icons/Button Blank Green-01.png" },
+	{   RepoFile::TYPE_ADDED, "A", "Added", ":icons/icons/Button Add-01.png" },
+	{   RepoFile::TYPE_DELETED, "D", "Deleted", ":icons/icons/Button Close-01.png" },
+	{   RepoFile::TYPE_RENAMED, "R", "Renamed", ":icons/icons/Button Reload-01.png" },
+	{   RepoFile::TYPE_MISSING, "M", "Missing", ":icons/icons/Button Help-01.png" },
+	// Default entry for unknown files. Must be last
+	{   RepoFile::TYPE_UNKNOWN, "?", "Unknown", ":icons/icons/Button Blank Gray-01.png" },
+};
+
+///////////////////////////////////////////////////////////////////////////////
+FileTableModel::FileTableModel(QObject *parent) :
+	QAbstractTableModel(parent),
+	showPath(false)
+{
+	for(size_t t=0; t<COUNTOF(stats); ++t)
+		statusIcons.append(QIcon(stats[t].icon));
+}
+
+//------------------------------------------------------------------------------
+void FileTableModel::setFiles(const QVector<RepoFile> &newFiles, bool newShowPath)
+{
+	beginResetModel();
+	files = newFiles;
+	showPath = newShowPath;
+	endResetModel();
+}
+
+//------------------------------------------------------------------------------
+void FileTableModel::appendFiles(const QVector<RepoFile> &newFiles)
+{
+	if(newFiles.empty())
+		return;
+
+	beginInsertRows(QModelIndex(), files.size(), files.size()+newFiles.size()-1);
+	files += newFiles;
+	endInsertRows();
+}
+
+//------------------------------------------------------------------------------
+void FileTableModel::clear()
+{
+	beginResetModel();
+	files.clear();
+	iconCache.clear();
+	endResetModel();
+}
+
+//------------------------------------------------------------------------------
+RepoFile FileTableModel::getFile(int row) const
+{
+	if(row<0 || row>=files.size())
+		return RepoFile();
+	return files[row];
+}
+
+//------------------------------------------------------------------------------
+int FileTableModel::rowCount(const QModelIndex &parent) const
+{
+	return parent.isValid() ? 0 : files.size();
+}
+
+//------------------------------------------------------------------------------
+int FileTableModel::columnCount(const QModelIndex &parent) const
+{
+	if(parent.isValid())
+		return 0;
+	return showPath ? COLUMN_PATH+1 : COLUMN_MODIFIED+1;
+}
+
+//------------------------------------------------------------------------------
+Qt::ItemFlags FileTableModel::flags(const QModelIndex &index) const
+{
+	if(!index.isValid())
+		return 0;
+	return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsDragEnabled;
+}
+
+//------------------------------------------------------------------------------
+QVariant FileTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if(orientation!=Qt::Horizontal)
+		return QVariant();
+
+	if(role==Qt::TextAlignmentRole)
+		return section==COLUMN_STATUS ? int(Qt::AlignCenter) : int(Qt::AlignLeft|Qt::AlignVCenter);
+
+	if(role!=Qt::DisplayRole)
+		return QVariant();
+
+	switch(section)
+	{
+	case COLUMN_STATUS:		return tr("S");
+	case COLUMN_FILENAME:	return tr("File");
+	case COLUMN_EXTENSION:	return tr("Ext");
+	case COLUMN_MODIFIED:	return tr("Modified");
+	case COLUMN_PATH:		return tr("Path");
+	}
+	return QVariant();
+}
+
+//------------------------------------------------------------------------------
+int FileTableModel::getStatusIndex(const RepoFile &e) const
+{
+	size_t t=0;
+	for(; t<COUNTOF(stats)-1; ++t)
+	{
+		if(e.getType() == stats[t].type)
+			break;
+	}
+	return t;
+}
+
+//------------------------------------------------------------------------------
+const QIcon &FileTableModel::getFileIcon(const RepoFile &e) const
+{
+	// The icon provider is slow, so only ask it once per extension
+	QString suffix = e.getSuffix().toLower();
+
+	iconcache_t::iterator it = iconCache.find(suffix);
+	if(it==iconCache.end())
+		it = iconCache.insert(suffix, iconProvider.icon(e.getFileInfo()));
+	return *it;
+}
+
+//------------------------------------------------------------------------------
+QVariant FileTableModel::data(const QModelIndex &index, int role) const
+{
+	if(!index.isValid() || index.row()>=files.size())
+		return QVariant();
+
+	const RepoFile &e = files[index.row()];
+	int column = index.column();
+
+	if(role==ROLE_FILEPATH)
+		return e.getFilePath();
+
+	switch(column)
+	{
+	case COLUMN_STATUS:
+		{
+			int s = getStatusIndex(e);
+			if(role==Qt::DisplayRole || role==ROLE_SORT)
+				return QString(stats[s].tag);
+			else if(role==Qt::DecorationRole)
+				return statusIcons[s];
+			else if(role==Qt::ToolTipRole)
+				return tr(stats[s].tooltip);
+			break;
+		}
+	case COLUMN_FILENAME:
+		if(role==Qt::DisplayRole || role==ROLE_SORT)
+		{
+			// In Tree mode the path is implicit so the file name is enough
+			if(showPath)
+				return QDir::toNativeSeparators(e.getFilePath());
+			return e.getFilename();
+		}
+		else if(role==Qt::DecorationRole)
+			return getFileIcon(e);
+		break;
+	case COLUMN_EXTENSION:
+		if(role==Qt::DisplayRole || role==ROLE_SORT)
+			return e.getSuffix();
+		break;
+	case COLUMN_MODIFIED:
+		if(role==Qt::DisplayRole)
+			return e.getLastModified().toString(Qt::SystemLocaleShortDate);
+		else if(role==ROLE_SORT)
+			return e.getLastModified();
+		break;
+	case COLUMN_PATH:
+		if(role==Qt::DisplayRole || role==ROLE_SORT)
+			return e.getPath();
+		break;
+	}
+
+	return QVariant();
+}
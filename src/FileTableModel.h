@@ -0,0 +1,62 @@
+#ifndef FILETABLEMODEL_H
+#define FILETABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QVector>
+#include <QHash>
+#include <QIcon>
+#include <QFileIconProvider>
+#include "FileTable.h"
+
+//////////////////////////////////////////////////////////////////////////
+// FileTableModel
+// A read-only table over the RepoFiles of the workspace. Cells are
+// generated on demand in data() so the cost of a view update is one
+// file reference per file rather than one item per cell.
+//////////////////////////////////////////////////////////////////////////
+class FileTableModel : public QAbstractTableModel
+{
+	Q_OBJECT
+public:
+	enum Column
+	{
+		COLUMN_STATUS,
+		COLUMN_FILENAME,
+		COLUMN_EXTENSION,
+		COLUMN_MODIFIED,
+		COLUMN_PATH
+	};
+
+	enum Role
+	{
+		ROLE_FILEPATH	= Qt::UserRole+1,	// Workspace-relative path of the file
+		ROLE_SORT		= Qt::UserRole+2	// Raw value used for sorting
+	};
+
+	explicit FileTableModel(QObject *parent = 0);
+
+	void setFiles(const QVector<RepoFile> &files, bool showPath);
+	void appendFiles(const QVector<RepoFile> &files);
+	void clear();
+	RepoFile getFile(int row) const;
+
+	int rowCount(const QModelIndex &parent = QModelIndex()) const;
+	int columnCount(const QModelIndex &parent = QModelIndex()) const;
+	QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+	Qt::ItemFlags flags(const QModelIndex &index) const;
+
+private:
+	int getStatusIndex(const RepoFile &e) const;
+	const QIcon &getFileIcon(const RepoFile &e) const;
+
+	typedef QHash<QString, QIcon> iconcache_t;
+
+	QVector<RepoFile>			files;
+	bool						showPath;
+	QVector<QIcon>				statusIcons;
+	QFileIconProvider			iconProvider;
+	mutable iconcache_t			iconCache;	// Keyed by file extension
+};
+
+#endif // FILETABLEMODEL_H
@@ -0,0 +1,143 @@
+#include "GlobMatcher.h"
+
+///////////////////////////////////////////////////////////////////////////////
+GlobMatcher::GlobMatcher(const QString &patternList) : patternCount(0)
+{
+	setPatterns(patternList);
+}
+
+//------------------------------------------------------------------------------
+// patternList is a comma-separated list of glob patterns. Patterns may be
+// enclosed in single or double quotes, which allows a comma to be part of
+// a pattern. Leading and trailing spaces of unquoted patterns are ignored
+void GlobMatcher::setPatterns(const QString &patternList)
+{
+	patternCount = 0;
+	exact.clear();
+	prefixes.clear();
+	suffixes.clear();
+	prefixLengths.clear();
+	suffixLengths.clear();
+	residual.clear();
+
+	int i = 0;
+	int n = patternList.length();
+	while(i<n)
+	{
+		// Skip leading spaces and newlines
+		while(i<n && (patternList[i]==',' || patternList[i]==' ' || patternList[i]=='\n' || patternList[i]=='\r'))
+			++i;
+
+		QChar delimiter = ',';
+		if(i<n && (patternList[i]=='\'' || patternList[i]=='"'))
+			delimiter = patternList[i++];
+
+		if(i>=n)
+			break;
+
+		int start = i;
+		while(i<n && patternList[i]!=delimiter && patternList[i]!='\n' && patternList[i]!='\r')
+			++i;
+
+		QString pattern = patternList.mid(start, i-start);
+
+		// Remove trailing spaces on a comma-delimited pattern
+		if(delimiter==',')
+		{
+			while(pattern.length()>1 && pattern.endsWith(' '))
+				pattern.chop(1);
+		}
+
+		addPattern(pattern);
+		++i;
+	}
+}
+
+//------------------------------------------------------------------------------
+static bool IsWild(QChar c)
+{
+	return c=='*' || c=='?' || c=='[';
+}
+
+//------------------------------------------------------------------------------
+void GlobMatcher::addLength(QList<int> &lengths, int length)
+{
+	if(!lengths.contains(length))
+		lengths.append(length);
+}
+
+//------------------------------------------------------------------------------
+void GlobMatcher::addPattern(const QString &pattern)
+{
+	++patternCount;
+
+	int n = pattern.length();
+	int k = 0;
+	while(k<n && !IsWild(pattern[k]))
+		++k;
+
+	int j = k;
+	while(j<n && pattern[j]=='*')
+		++j;
+
+	if(k==n)
+	{
+		exact.insert(pattern);
+		return;
+	}
+
+	if(j==n)
+	{
+		prefixes.insert(pattern.left(k));
+		addLength(prefixLengths, k);
+		return;
+	}
+
+	if(k==0)
+	{
+		for(k=j; k<n && !IsWild(pattern[k]); ++k) {}
+		if(k==n)
+		{
+			suffixes.insert(pattern.mid(j));
+			addLength(suffixLengths, n-j);
+			return;
+		}
+	}
+
+	residual.append(QRegExp(pattern, Qt::CaseSensitive, QRegExp::Wildcard));
+}
+
+//------------------------------------------------------------------------------
+bool GlobMatcher::match(const QString &path) const
+{
+	if(exact.contains(path))
+		return true;
+
+	int n = path.length();
+	foreach(int length, prefixLengths)
+	{
+		if(length<=n && prefixes.contains(path.left(length)))
+			return true;
+	}
+
+	foreach(int length, suffixLengths)
+	{
+		if(length<=n && suffixes.contains(path.right(length)))
+			return true;
+	}
+
+	foreach(const QRegExp &rx, residual)
+	{
+		if(rx.exactMatch(path))
+			return true;
+	}
+	return false;
+}
+
+//------------------------------------------------------------------------------
+// As in vfile_scan(), a directory is also skipped if its path followed by
+// a slash matches, so "build/*" excludes the whole of "build"
+bool GlobMatcher::matchDir(const QString &dirPath) const
+{
+	return match(dirPath) || match(dirPath + '/');
+}
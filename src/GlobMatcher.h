@@ -0,0 +1,41 @@
+#ifndef GLOBMATCHER_H
+#define GLOBMATCHER_H
+
+#include <QString>
+#include <QSet>
+#include <QList>
+#include <QRegExp>
+
+//////////////////////////////////////////////////////////////////////////
+// GlobMatcher
+// A compiled list of glob patterns, as used by the ignore-glob setting.
+// This follows the Glob object of glob.c: the list is split the same way
+// and patterns of the forms "LITERAL", "LITERAL*" and "*LITERAL" are
+// looked up in hash sets, so only the remaining patterns are matched
+// one by one. Matching is case sensitive, as in vcs.
+//////////////////////////////////////////////////////////////////////////
+class GlobMatcher
+{
+public:
+	GlobMatcher() : patternCount(0) {}
+	explicit GlobMatcher(const QString &patternList);
+
+	void setPatterns(const QString &patternList);
+	bool isEmpty() const { return patternCount==0; }
+	bool match(const QString &path) const;
+	bool matchDir(const QString &dirPath) const;
+
+private:
+	void addPattern(const QString &pattern);
+	static void addLength(QList<int> &lengths, int length);
+
+	int					patternCount;
+	QSet<QString>		exact;			// LITERAL
+	QSet<QString>		prefixes;		// LITERAL*
+	QSet<QString>		suffixes;		// *LITERAL
+	QList<int>			prefixLengths;	// Distinct lengths of the prefixes
+	QList<int>			suffixLengths;	// Distinct lengths of the suffixes
+	QList<QRegExp>		residual;		// All other patterns
+};
+
+#endif // GLOBMATCHER_H
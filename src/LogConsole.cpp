@@ -0,0 +1,121 @@
+#include "LogConsole.h"
+#include <QTextBrowser>
+#include <QTextCursor>
+#include <QScrollBar>
+
+///////////////////////////////////////////////////////////////////////////////
+LogConsole::LogConsole(QTextBrowser *view, QObject *parent) :
+	QObject(parent),
+	view(view),
+	pendingLines(0)
+{
+	// The log is append-only so there is nothing to undo
+	view->document()->setUndoRedoEnabled(false);
+	view->document()->setMaximumBlockCount(MAX_LINES);
+
+	timer.setSingleShot(true);
+	timer.setInterval(FLUSH_MSEC);
+	connect(&timer, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+//------------------------------------------------------------------------------
+void LogConsole::append(const QString &text, bool isHTML)
+{
+	if(text.isEmpty())
+		return;
+
+	int lines = isHTML ? 1 : text.count('\n');
+
+	// Consecutive plain text is inserted with a single call
+	if(!isHTML && !pending.empty() && !pending.last().isHTML)
+	{
+		pending.last().text += text;
+		pending.last().lines += lines;
+	}
+	else
+	{
+		Entry e;
+		e.text = text;
+		e.isHTML = isHTML;
+		e.lines = lines;
+		pending.append(e);
+	}
+	pendingLines += lines;
+
+	// The view would drop the oldest lines anyway, so drop them here
+	// before they cost anything. Cutting text out of a merged entry
+	// copies the rest of it, so let the queue run over by MAX_LINES
+	// before cutting it back, rather than cutting on every append
+	if(pendingLines>2*MAX_LINES)
+		trimPending();
+
+	if(!timer.isActive())
+		timer.start();
+}
+
+//------------------------------------------------------------------------------
+// Drop the oldest queued output until at most MAX_LINES lines are left
+void LogConsole::trimPending()
+{
+	while(pendingLines>MAX_LINES && pending.first().lines<=pendingLines-MAX_LINES)
+	{
+		pendingLines -= pending.first().lines;
+		pending.removeFirst();
+	}
+
+	// Consecutive plain text is merged into one entry, so it has to be
+	// cut line by line rather than dropped whole
+	if(pendingLines>MAX_LINES && !pending.first().isHTML)
+	{
+		Entry &e = pending.first();
+		int count = pendingLines-MAX_LINES;
+		int pos = -1;
+		for(int i=0; i<count; ++i)
+			pos = e.text.indexOf('\n', pos+1);
+		e.text.remove(0, pos+1);
+		e.lines -= count;
+		pendingLines -= count;
+	}
+}
+
+//------------------------------------------------------------------------------
+void LogConsole::flush()
+{
+	timer.stop();
+	if(pending.empty())
+		return;
+
+	trimPending();
+
+	// Follow the output only if the user has not scrolled away from it
+	QScrollBar *sb = view->verticalScrollBar();
+	bool at_end = sb->value()==sb->maximum();
+
+	QTextCursor c(view->document());
+	c.movePosition(QTextCursor::End);
+	c.beginEditBlock();
+	for(QList<Entry>::const_iterator it=pending.begin(); it!=pending.end(); ++it)
+	{
+		if(it->isHTML)
+			c.insertHtml(it->text);
+		else
+			c.insertText(it->text);
+	}
+	c.endEditBlock();
+
+	pending.clear();
+	pendingLines = 0;
+
+	if(at_end)
+		sb->setValue(sb->maximum());
+}
+
+//------------------------------------------------------------------------------
+void LogConsole::clear()
+{
+	timer.stop();
+	pending.clear();
+	pendingLines = 0;
+	view->clear();
+	view->document()->setMaximumBlockCount(MAX_LINES);
+}
@@ -0,0 +1,54 @@
+#ifndef LOGCONSOLE_H
+#define LOGCONSOLE_H
+
+#include <QObject>
+#include <QTimer>
+#include <QList>
+#include <QString>
+
+class QTextBrowser;
+
+//////////////////////////////////////////////////////////////////////////
+// LogConsole
+// Collects log output and writes it to a QTextBrowser in one edit block
+// every FLUSH_MSEC, rather than laying out the document once per line.
+// The document keeps at most MAX_LINES blocks. Output queued between
+// flushes is kept under 2*MAX_LINES lines and trimmed to MAX_LINES
+// before it is inserted, so a chatty command costs the UI a bounded
+// amount of work and memory no matter how much it prints.
+//////////////////////////////////////////////////////////////////////////
+class LogConsole : public QObject
+{
+	Q_OBJECT
+public:
+	explicit LogConsole(QTextBrowser *view, QObject *parent = 0);
+
+	void append(const QString &text, bool isHTML);
+	void clear();
+
+public slots:
+	void flush();
+
+private:
+	struct Entry
+	{
+		QString	text;
+		bool	isHTML;
+		int		lines;
+	};
+
+	void trimPending();
+
+	enum
+	{
+		FLUSH_MSEC	= 50,
+		MAX_LINES	= 10000
+	};
+
+	QTextBrowser	*view;
+	QTimer			timer;
+	QList<Entry>	pending;		// Output not yet in the view, oldest first
+	int				pendingLines;
+};
+
+#endif // LOGCONSOLE_H
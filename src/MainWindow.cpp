@@ -13,7 +13,6 @@
 #include <QInputDialog>
 #include <QDrag>
 #include <QMimeData>
-#include <QFileIconProvider>
 #include <QDebug>
 #include <QProgressBar>
 #include "CommitDialog.h"
@@ -21,6 +20,8 @@
 #include "CloneDialog.h"
 #include "Utils.h"
 #include "LoggedProcess.h"
+#include "WorkspaceScanner.h"
+#include "LogConsole.h"
 
 #define COUNTOF(array) (sizeof(array)/sizeof(array[0]))
 
@@ -29,16 +30,7 @@
 //-----------------------------------------------------------------------------
 enum
 {
-	COLUMN_STATUS,
-	COLUMN_FILENAME,
-	COLUMN_EXTENSION,
-	COLUMN_MODIFIED,
-	COLUMN_PATH
-};
-
-enum
-{
-	REPODIRMODEL_ROLE_PATH = Qt::UserRole+1
+	REPODIRMODEL_ROLE_PATH = DirTreeModel::ROLE_PATH
 };
 
 //-----------------------------------------------------------------------------
@@ -110,11 +102,20 @@ MainWindow::MainWindow(QWidget *parent, QString *workspacePath, bool portableMod
 {
 	ui->setupUi(this);
 
+	logConsole = new LogConsole(ui->textBrowser, this);
+
 	QAction *separator = new QAction(this);
 	separator->setSeparator(true);
 
 	// TableView
-	ui->tableView->setModel(&repoFileModel);
+	repoFileProxy.setSourceModel(&repoFileModel);
+	repoFileProxy.setSortRole(FileTableModel::ROLE_SORT);
+	repoFileProxy.setDynamicSortFilter(true);
+	ui->tableView->setModel(&repoFileProxy);
+
+	// All rows have the same height so the view never has to measure them
+	ui->tableView->verticalHeader()->setResizeMode(QHeaderView::Fixed);
+	ui->tableView->verticalHeader()->setDefaultSectionSize(ui->tableView->fontMetrics().height()+6);
 
 	ui->tableView->addAction(ui->actionDiff);
 	ui->tableView->addAction(ui->actionHistory);
@@ -186,6 +187,8 @@ MainWindow::MainWindow(QWidget *parent, QString *workspacePath, bool portableMod
 	progressBar->setVisible(false);
 
 	viewMode = VIEWMODE_TREE;
+	scanner = 0;
+	scanGeneration = 0;
 
 	QString ini_path = QDir::toNativeSeparators(QCoreApplication::applicationDirPath() + QDir::separator() + QCoreApplication::applicationName() + ".ini");
 	qsettings = new QSettings(QSettings::UserScope, QCoreApplication::organizationName(), QCoreApplication::applicationName());
@@ -208,14 +211,11 @@ MainWindow::MainWindow(QWidget *parent, QString *workspacePath, bool portableMod
 //------------------------------------------------------------------------------
 MainWindow::~MainWindow()
 {
+	cancelScan();
 	stopUI();
 	saveSettings();
 	delete qsettings;
 
-	// Dispose RepoFiles
-	for(filemap_t::iterator it = workspaceFiles.begin(); it!=workspaceFiles.end(); ++it)
-		delete *it;
-
 	delete ui;
 }
 //-----------------------------------------------------------------------------
@@ -511,38 +511,6 @@ void MainWindow::onOpenRecent()
 	openWorkspace(workspace);
 }
 
-//------------------------------------------------------------------------------
-bool MainWindow::scanDirectory(QFileInfoList &entries, const QString& dirPath, const QString &baseDir, const QString ignoreSpec)
-{
-	QDir dir(dirPath);
-
-	setStatus(dirPath);
-	QCoreApplication::processEvents();
-
-	QFileInfoList list = dir.entryInfoList(QDir::Dirs | QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot);
-	for (int i=0; i<list.count(); ++i)
-	{
-		QFileInfo info = list[i];
-		QString filename = info.fileName();
-		QString filepath = info.filePath();
-		QString rel_path = filepath;
-		rel_path.remove(baseDir+PATH_SEP);
-
-		// Skip ignored files
-		if(!ignoreSpec.isEmpty() && QDir::match(ignoreSpec, rel_path))
-			continue;
-
-		if (info.isDir())
-		{
-			if(!scanDirectory(entries, filepath, baseDir, ignoreSpec))
-				return false;
-		}
-		else
-			entries.push_back(info);
-	}
-	return true;
-}
-
 //------------------------------------------------------------------------------
 void MainWindow::enableActions(bool on)
 {
@@ -571,21 +539,30 @@ void MainWindow::enableActions(bool on)
 //------------------------------------------------------------------------------
 bool MainWindow::refresh()
 {
-	// Load repository info
-	RepoStatus st = getRepoStatus();
+	// Load repository info, along with everything else describe reports
+	outputmap_t parts;
+	RepoStatus st = describeWorkspace(parts);
 
 	if(st==REPO_NOT_FOUND)
 	{
 		setStatus(tr("No workspace detected."));
 		enableActions(false);
-		repoFileModel.removeRows(0, repoFileModel.rowCount());
+		cancelScan();
+		repoFileModel.clear();
 		repoDirModel.clear();
 		return false;
 	}
 	
-	loadVCSSettings();
-	scanWorkspace();
-	setStatus("");
+	if(parts.empty())
+	{
+		loadVCSSettings();
+		scanWorkspace();
+	}
+	else
+	{
+		applyvcsSettings(parts["settings"], parts);
+		scanWorkspace(parts["ls"], parts["stash"]);
+	}
 	enableActions(true);
 
 	QString title = "Fuel";
@@ -599,137 +576,49 @@ bool MainWindow::refresh()
 //------------------------------------------------------------------------------
 void MainWindow::scanWorkspace()
 {
-	// Scan all workspace files
-	QFileInfoList all_files;
-	QString wkdir = getCurrentWorkspace();
-
-	if(wkdir.isEmpty())
+	if(getCurrentWorkspace().isEmpty())
 		return;
 
+	// A refresh which is still running is superseded by this one
+	cancelScan();
+
 	// Retrieve the status of files tracked by vcs
-	QStringList res;
-	if(!runVCS(QStringList() << "ls" << "-l", &res, RUNGLAGS_SILENT_ALL))
+	QStringList status_lines;
+	if(!runVCS(QStringList() << "ls" << "-l", &status_lines, RUNGLAGS_SILENT_ALL))
 		return;
 
-	bool scan_files = ui->actionViewUnknown->isChecked();
-
-	setStatus(tr("Scanning Workspace..."));
-	setEnabled(false);
-	QApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
-
-	// Dispose RepoFiles
-	for(filemap_t::iterator it = workspaceFiles.begin(); it!=workspaceFiles.end(); ++it)
-		delete *it;
-
-	workspaceFiles.clear();
-	pathSet.clear();
-
-	if(scan_files)
-	{
-		QCoreApplication::processEvents();
-
-		QString ignore;
-		// If we should not be showing ignored files, fill in the ignored spec
-		if(!ui->actionViewIgnored->isChecked())
-		{
-			// QDir expects multiple specs being separated by a semicolon
-			ignore = settings.Mappings[FUEL_SETTING_IGNORE_GLOB].Value.toString().replace(',',';');
-		}
-
-		scanDirectory(all_files, wkdir, wkdir, ignore);
-
-		for(QFileInfoList::iterator it=all_files.begin(); it!=all_files.end(); ++it)
-		{
-			QString filename = it->fileName();
-			QString fullpath = it->absoluteFilePath();
-
-			RepoFile *rf = new RepoFile(*it, RepoFile::TYPE_UNKNOWN, wkdir);
-			workspaceFiles.insert(rf->getFilePath(), rf);
-			pathSet.insert(rf->getPath());
-		}
-	}
-
-	setStatus(tr("Updating..."));
-	QCoreApplication::processEvents();
-
-	// Update Files and Directories
-
-	for(QStringList::iterator line_it=res.begin(); line_it!=res.end(); ++line_it)
-	{
-		QString line = (*line_it).trimmed();
-		if(line.length()==0)
-			continue;
-
-		QString status_text = line.left(10).trimmed();
-		QString fname = line.right(line.length() - 10).trimmed();
-		RepoFile::EntryType type = RepoFile::TYPE_UNKNOWN;
-
-		// Generate a RepoFile for all non-existant vcs files
-		// or for all files if we skipped scanning the workspace
-		bool add_missing = !scan_files;
+	QStringList stash_lines;
+	if(!runVCS(QStringList() << "stash" << "ls", &stash_lines, RUNGLAGS_SILENT_ALL))
+		return;
 
-		if(status_text=="EDITED")
-			type = RepoFile::TYPE_EDITTED;
-		else if(status_text=="ADDED")
-			type = RepoFile::TYPE_ADDED;
-		else if(status_text=="DELETED")
-		{
-			type = RepoFile::TYPE_DELETED;
-			add_missing = true;
-		}
-		else if(status_text=="MISSING")
-		{
-			type = RepoFile::TYPE_MISSING;
-			add_missing = true;
-		}
-		else if(status_text=="RENAMED")
-			type = RepoFile::TYPE_RENAMED;
-		else if(status_text=="UNCHANGED")
-			type = RepoFile::TYPE_UNCHANGED;
-
-		// Filter unwanted file types
-		if( ((type & RepoFile::TYPE_MODIFIED) && !ui->actionViewModified->isChecked()) ||
-			((type & RepoFile::TYPE_UNCHANGED) && !ui->actionViewUnchanged->isChecked() ))
-		{
-			workspaceFiles.remove(fname);
-			continue;
-		}
-		else
-			add_missing = true;
+	scanWorkspace(status_lines, stash_lines);
+}
 
-		filemap_t::iterator it = workspaceFiles.find(fname);
+//------------------------------------------------------------------------------
+void MainWindow::scanWorkspace(const QStringList &statusLines, const QStringList &stashLines)
+{
+	QString wkdir = getCurrentWorkspace();
 
-		RepoFile *rf = 0;
-		if(add_missing && it==workspaceFiles.end())
-		{
-			QFileInfo info(wkdir+QDir::separator()+fname);
-			rf = new RepoFile(info, type, wkdir);
-			workspaceFiles.insert(rf->getFilePath(), rf);
-		}
+	if(wkdir.isEmpty())
+		return;
 
-		if(!rf)
-		{
-			it = workspaceFiles.find(fname);
-			Q_ASSERT(it!=workspaceFiles.end());
-			rf = *it;
-		}
+	cancelScan();
 
-		rf->setType(type);
+	bool scan_files = ui->actionViewUnknown->isChecked();
 
-		QString path = rf->getPath();
-		pathSet.insert(path);
-	}
+	QString ignore;
+	// If we should not be showing ignored files, fill in the ignored spec
+	if(scan_files && !ui->actionViewIgnored->isChecked())
+		ignore = settings.Mappings[FUEL_SETTING_IGNORE_GLOB].Value.toString();
 
 	// Load the stash
+	const QStringList &res = stashLines;
 	stashMap.clear();
-	res.clear();
-	if(!runVCS(QStringList() << "stash" << "ls", &res, RUNGLAGS_SILENT_ALL))
-		return;
 
 	// 19: [5c46757d4b9765] on 2012-04-22 04:41:15
 	QRegExp stash_rx("\\s*(\\d+):\\s+\\[(.*)\\] on (\\d+)-(\\d+)-(\\d+) (\\d+):(\\d+):(\\d+)", Qt::CaseInsensitive);
 
-	for(QStringList::iterator line_it=res.begin(); line_it!=res.end(); )
+	for(QStringList::const_iterator line_it=res.begin(); line_it!=res.end(); )
 	{
 		QString line = *line_it;
 
@@ -755,169 +644,135 @@ void MainWindow::scanWorkspace()
 		stashMap.insert(name, id);
 	}
 
+	updateStashView();
 
-	// Update the file item model
-	updateDirView();
+	// The file model refers to the file table so detach it first
+	repoFileModel.clear();
+	workspaceFiles.clear();
+	workspaceFiles.setWorkspace(wkdir);
 	updateFileView();
-	updateStashView();
 
-	setEnabled(true);
-	setStatus("");
-	QApplication::restoreOverrideCursor();
+	// Scan on a worker thread. The views are filled in as results arrive
+	// in onScanFilesFound() and the scan is finalized in onScanDone()
+	setStatus(tr("Scanning Workspace..."));
+	progressBar->setVisible(true);
+
+	scanner = new WorkspaceScanner(++scanGeneration, wkdir, statusLines, scan_files,
+								   ui->actionViewModified->isChecked(), ui->actionViewUnchanged->isChecked(),
+								   ignore, this);
+	connect(scanner, SIGNAL(filesFound(int)), SLOT(onScanFilesFound(int)));
+	connect(scanner, SIGNAL(scanDone(int)), SLOT(onScanDone(int)));
+	scanner->start();
 }
 
 //------------------------------------------------------------------------------
-static void addPathToTree(QStandardItem &root, const QString &path)
+void MainWindow::cancelScan()
 {
-	QStringList dirs = path.split('/');
-	QStandardItem *parent = &root;
-
-	QString fullpath;
-	for(QStringList::iterator it = dirs.begin(); it!=dirs.end(); ++it)
-	{
-		const QString &dir = *it;
-		fullpath += dir;
-
-		// Find the child that matches this subdirectory
-		bool found = false;
-		for(int r=0; r<parent->rowCount(); ++r)
-		{
-			QStandardItem *child = parent->child(r, 0);
-			Q_ASSERT(child);
-			if(child->text() == dir)
-			{
-				parent = child;
-				found = true;
-			}
-		}
+	if(!scanner)
+		return;
 
-		if(!found) // Generate it
-		{
-			QStandardItem *child = new QStandardItem(QIcon(":icons/icons/Folder-01.png"), dir);
-			child->setData(fullpath); // keep the full path to simplify selection
-			parent->appendRow(child);
-			parent = child;
-		}
-		fullpath += '/';
-	}
+	scanner->cancel();
+	scanner->wait();
+	delete scanner;
+	scanner = 0;
+	progressBar->setVisible(false);
 }
 
 //------------------------------------------------------------------------------
-void MainWindow::updateDirView()
+void MainWindow::onScanFilesFound(int generation)
 {
-	// Directory View
-	repoDirModel.clear();
+	// Ignore notifications from a scan we have cancelled
+	if(!scanner || generation!=scanGeneration)
+		return;
 
-	QStringList header;
-	header << tr("Folders");
-	repoDirModel.setHorizontalHeaderLabels(header);
+	WorkspaceScanner::filelist_t found;
+	scanner->takeResults(found);
 
-	QStandardItem *root = new QStandardItem(QIcon(":icons/icons/My Documents-01.png"), projectName);
-	root->setData(""); // Empty Path
-	root->setEditable(false);
+	int old_size = workspaceFiles.size();
+	int old_dirs = workspaceFiles.dirCount();
 
-	repoDirModel.appendRow(root);
-	for(stringset_t::iterator it = pathSet.begin(); it!=pathSet.end(); ++it)
+	filelist_t visible;
+	foreach(const WorkspaceScanner::ScannedFile &f, found)
 	{
-		const QString &dir = *it;
-		if(dir.isEmpty())
+		RepoFile rf = workspaceFiles.add(f.Path, f.Name, f.Type);
+
+		// A file reported twice is already in the view
+		if(rf.getRow()<old_size)
 			continue;
 
-		addPathToTree(*root, dir);
+		// In Tree mode, only files in the selected dirs are shown
+		if(viewMode==VIEWMODE_LIST || selectedDirs.contains(f.Path))
+			visible.append(rf);
 	}
-	ui->treeView->expandToDepth(0);
-	ui->treeView->sortByColumn(0, Qt::AscendingOrder);
+
+	// Show new folders right away
+	for(int d=old_dirs; d<workspaceFiles.dirCount(); ++d)
+		repoDirModel.addPath(workspaceFiles.getDir(d));
+
+	repoFileModel.appendFiles(visible);
+	setStatus(tr("Scanning Workspace... %0 files").arg(workspaceFiles.size()));
 }
 
 //------------------------------------------------------------------------------
-void MainWindow::updateFileView()
+void MainWindow::onScanDone(int generation)
 {
-	// File View
-	repoFileModel.clear();
-
-	QStringList header;
-	header << tr("S") << tr("File") << tr("Ext") << tr("Modified");
-
-	bool multiple_dirs = selectedDirs.count()>1;
-
-	bool show_path = viewMode==VIEWMODE_LIST || multiple_dirs;
-
-	if(show_path)
-		header << tr("Path");
-
-	repoFileModel.setHorizontalHeaderLabels(header);
-	repoFileModel.horizontalHeaderItem(COLUMN_STATUS)->setTextAlignment(Qt::AlignCenter);
-
-	struct { RepoFile::EntryType type; const char *tag; const char *tooltip; const char *icon; }
-	stats[] =
-	{
-		{   RepoFile::TYPE_EDITTED, "E", "Edited", ":icons/icons/Button Blank Yellow-01.png" },
-		{   RepoFile::TYPE_UNCHANGED, "U", "Unchanged", ":icons/icons/Button Blank Green-01.png" },
-		{   RepoFile::TYPE_ADDED, "A", "Added", ":icons/icons/Button Add-01.png" },
-		{   RepoFile::TYPE_DELETED, "D", "Deleted", ":icons/icons/Button Close-01.png" },
-		{   RepoFile::TYPE_RENAMED, "R", "Renamed", ":icons/icons/Button Reload-01.png" },
-		{   RepoFile::TYPE_MISSING, "M", "Missing", ":icons/icons/Button Help-01.png" },
-	};
-
-	QFileIconProvider icon_provider;
+	if(!scanner || generation!=scanGeneration)
+		return;
 
-	size_t item_id=0;
-	for(filemap_t::iterator it = workspaceFiles.begin(); it!=workspaceFiles.end(); ++it)
-	{
-		const RepoFile &e = *it.value();
-		QString path = e.getPath();
+	// Collect any files still in flight
+	onScanFilesFound(generation);
 
-		// In Tree mode, filter all items not included in the current dir
-		if(viewMode==VIEWMODE_TREE && !selectedDirs.contains(path))
-			continue;
+	scanner->wait();
+	delete scanner;
+	scanner = 0;
 
-		// Status Column
-		const char *tag = "?"; // Default Tag
-		const char *tooltip = "Unknown";
-		const char *status_icon= ":icons/icons/Button Blank Gray-01.png"; // Default icon
+	// Order the table so folder selections become simple ranges
+	workspaceFiles.sort();
 
-		for(size_t t=0; t<COUNTOF(stats); ++t)
-		{
-			if(e.getType() == stats[t].type)
-			{
-				tag = stats[t].tag;
-				tooltip = stats[t].tooltip;
-				status_icon = stats[t].icon;
-				break;
-			}
-		}
-
-		QStandardItem *status = new QStandardItem(QIcon(status_icon), tag);
-		status->setToolTip(tooltip);
-		repoFileModel.setItem(item_id, COLUMN_STATUS, status);
+	// Drop the folders which no longer exist
+	updateDirView();
+	ui->tableView->resizeColumnsToContents();
 
-		QFileInfo finfo = e.getFileInfo();
-		QIcon icon = icon_provider.icon(finfo);
+	progressBar->setVisible(false);
+	setStatus("");
+}
 
-		QStandardItem *filename_item = 0;
-		if(show_path)
-		{
-			repoFileModel.setItem(item_id, COLUMN_PATH, new QStandardItem(path));
-			filename_item = new QStandardItem(icon, QDir::toNativeSeparators(e.getFilePath()));
-		}
-		else // In Tree mode the path is implicit so the file name is enough
-			filename_item = new QStandardItem(icon, e.getFilename());
+//------------------------------------------------------------------------------
+void MainWindow::updateDirView()
+{
+	// Directory View
+	// Folders which survive the refresh keep their expansion and selection
+	repoDirModel.setRootName(projectName);
+	repoDirModel.setPaths(workspaceFiles.getDirSet());
+	ui->treeView->expandToDepth(0);
+}
 
-		Q_ASSERT(filename_item);
-		// Keep the path in the user data
-		filename_item->setData(e.getFilePath());
-		repoFileModel.setItem(item_id, COLUMN_FILENAME, filename_item);
+//------------------------------------------------------------------------------
+void MainWindow::updateFileView()
+{
+	bool multiple_dirs = selectedDirs.count()>1;
+	bool show_path = viewMode==VIEWMODE_LIST || multiple_dirs;
 
-		repoFileModel.setItem(item_id, COLUMN_EXTENSION, new QStandardItem(finfo.suffix()));
-		repoFileModel.setItem(item_id, COLUMN_MODIFIED, new QStandardItem(finfo.lastModified().toString(Qt::SystemLocaleShortDate)));
+	filelist_t files;
 
-		++item_id;
+	if(viewMode==VIEWMODE_TREE)
+	{
+		// In Tree mode, only show the files of the selected dirs
+		for(stringset_t::iterator it=selectedDirs.begin(); it!=selectedDirs.end(); ++it)
+			workspaceFiles.getDirFiles(*it, files);
+	}
+	else
+	{
+		// The root folder subtree holds all files
+		files.reserve(workspaceFiles.size());
+		workspaceFiles.getSubtreeFiles("", files);
 	}
 
+	repoFileModel.setFiles(files, show_path);
+
 	ui->tableView->horizontalHeader()->setDefaultAlignment(Qt::AlignLeft);
 	ui->tableView->resizeColumnsToContents();
 	ui->tableView->horizontalHeader()->setMovable(true);
-	ui->tableView->resizeRowsToContents();
 	// Needed on OSX as the preset value from the GUI editor is not always reflected
 	ui->tableView->horizontalHeader()->setStretchLastSection(true);
 }
@@ -933,9 +788,13 @@ MainWindow::RepoStatus MainWindow::getRepoStatus()
 	if(!runvcsRaw(QStringList() << "info", &res, &exit_code, RUNGLAGS_SILENT_ALL))
 		return REPO_NOT_FOUND;
 
-	bool run_ok = exit_code == EXIT_SUCCESS;
+	return parseRepoStatus(res, exit_code == EXIT_SUCCESS);
+}
 
-	for(QStringList::iterator it=res.begin(); it!=res.end(); ++it)
+//------------------------------------------------------------------------------
+MainWindow::RepoStatus MainWindow::parseRepoStatus(const QStringList &infoLines, bool runOk)
+{
+	for(QStringList::const_iterator it=infoLines.begin(); it!=infoLines.end(); ++it)
 	{
 		int col_index = it->indexOf(':');
 		if(col_index==-1)
@@ -952,7 +811,7 @@ MainWindow::RepoStatus MainWindow::getRepoStatus()
 				return REPO_NOT_FOUND;
 		}
 
-		if(run_ok)
+		if(runOk)
 		{
 			if(key=="project-name")
 				projectName = value;
@@ -961,7 +820,53 @@ MainWindow::RepoStatus MainWindow::getRepoStatus()
 		}
 	}
 
-	return run_ok ? REPO_OK : REPO_NOT_FOUND;
+	return runOk ? REPO_OK : REPO_NOT_FOUND;
+}
+
+//------------------------------------------------------------------------------
+// Retrieve the info, settings, remote url, stash and file status of the
+// workspace with a single "describe" run, instead of one process for each.
+// The output is split into parts by name. If the vcs executable does not
+// know describe, parts is left empty and the status comes from "info"
+MainWindow::RepoStatus MainWindow::describeWorkspace(outputmap_t &parts)
+{
+	parts.clear();
+
+	QStringList args;
+	args << "describe";
+	for(Settings::mappings_t::iterator it=settings.Mappings.begin(); it!=settings.Mappings.end(); ++it)
+	{
+		Settings::Setting::SettingType type = it->Type;
+		if(type == Settings::Setting::TYPE_VCS_GLOBAL || type == Settings::Setting::TYPE_VCS_LOCAL)
+			args << it.key();
+	}
+
+	QStringList res;
+	int exit_code = EXIT_FAILURE;
+	if(!runvcsRaw(args, &res, &exit_code, RUNGLAGS_SILENT_ALL))
+		return REPO_NOT_FOUND;
+
+	// Anything before the first part, like an error, counts as info
+	QString part = "info";
+	for(QStringList::const_iterator it=res.begin(); it!=res.end(); ++it)
+	{
+		if(it->startsWith("== "))
+		{
+			part = it->mid(3).trimmed();
+			parts[part].clear();
+		}
+		else
+			parts[part].append(*it);
+	}
+
+	// The file list comes last, so without it the run did not complete
+	if(exit_code != EXIT_SUCCESS || !parts.contains("ls"))
+	{
+		parts.clear();
+		return getRepoStatus();
+	}
+
+	return parseRepoStatus(parts["info"], true);
 }
 //------------------------------------------------------------------------------
 void MainWindow::updateStashView()
@@ -985,14 +890,7 @@ void MainWindow::updateStashView()
 //------------------------------------------------------------------------------
 void MainWindow::log(const QString &text, bool isHTML)
 {
-	QTextCursor c = ui->textBrowser->textCursor();
-	c.movePosition(QTextCursor::End);
-	ui->textBrowser->setTextCursor(c);
-
-	if(isHTML)
-		ui->textBrowser->insertHtml(text);
-	else
-		ui->textBrowser->insertPlainText(text);
+	logConsole->append(text, isHTML);
 }
 
 //------------------------------------------------------------------------------
@@ -1004,7 +902,7 @@ void MainWindow::setStatus(const QString &text)
 //------------------------------------------------------------------------------
 void MainWindow::on_actionClearLog_triggered()
 {
-	ui->textBrowser->clear();
+	logConsole->clear();
 }
 
 //------------------------------------------------------------------------------
@@ -1395,17 +1293,30 @@ void MainWindow::getSelectionPaths(stringset_t &paths)
 // Select all workspace files that match the includeMask
 void MainWindow::getAllFilenames(QStringList &filenames, int includeMask)
 {
-	for(filemap_t::iterator it=workspaceFiles.begin(); it!=workspaceFiles.end(); ++it)
+	for(int row=0; row<workspaceFiles.size(); ++row)
 	{
-		const RepoFile &e = *(*it);
-
 		// Skip unwanted file types
-		if(!(includeMask & e.getType()))
+		if(!(includeMask & workspaceFiles.getType(row)))
 			continue;
 
-		filenames.append(e.getFilePath());
+		filenames.append(workspaceFiles.getFilePath(row));
+	}
+}
+//------------------------------------------------------------------------------
+// True if one of the parent directories of path, including the root, is in dirs
+bool MainWindow::isInsideSelectedDir(const QString &path, const stringset_t &dirs)
+{
+	if(dirs.contains(""))
+		return true;
+
+	for(int sep = path.indexOf(PATH_SEP); sep!=-1; sep = path.indexOf(PATH_SEP, sep+1))
+	{
+		if(dirs.contains(path.left(sep)))
+			return true;
 	}
+	return false;
 }
+
 //------------------------------------------------------------------------------
 void MainWindow::getDirViewSelection(QStringList &filenames, int includeMask, bool allIfEmpty)
 {
@@ -1418,39 +1329,36 @@ void MainWindow::getDirViewSelection(QStringList &filenames, int includeMask, bo
 		getSelectionPaths(paths);
 	}
 
-	// Select the actual files form the selected directories
-	for(filemap_t::iterator it=workspaceFiles.begin(); it!=workspaceFiles.end(); ++it)
-	{
-		const RepoFile &e = *(*it);
-
-		// Skip unwanted file types
-		if(!(includeMask & e.getType()))
-			continue;
+	// No directories means all files
+	if(paths.empty())
+		paths.insert("");
 
-		bool include = true;
+	// Drop directories which are inside another selected one so that
+	// no file is reported twice. Each of their parents is looked up,
+	// since in sort order a sibling such as "src.old" can come between
+	// "src" and "src/foo"
+	QStringList sorted_paths = paths.toList();
+	sorted_paths.sort();
 
-		// If we have a limited set of paths to filter, check them
-		if(!paths.empty())
-			include = false;
+	filelist_t files;
+	for(int i=0; i<sorted_paths.size(); ++i)
+	{
+		const QString &path = sorted_paths[i];
+		if(!path.isEmpty() && isInsideSelectedDir(path, paths))
+			continue;
 
-		for(stringset_t::iterator p_it=paths.begin(); p_it!=paths.end(); ++p_it)
-		{
-			const QString &path = *p_it;
-			// An empty path is the root folder, so it includes all files
-			// If the file's path starts with this, we include id
-			if(path.isEmpty() || e.getPath().indexOf(path)==0)
-			{
-				include = true;
-				break;
-			}
-		}
+		workspaceFiles.getSubtreeFiles(path, files);
+	}
 
-		if(!include)
+	// Select the actual files form the selected directories
+	foreach(const RepoFile &e, files)
+	{
+		// Skip unwanted file types
+		if(!(includeMask & e.getType()))
 			continue;
 
 		filenames.append(e.getFilePath());
 	}
-
 }
 
 //------------------------------------------------------------------------------
@@ -1468,22 +1376,19 @@ void MainWindow::getFileViewSelection(QStringList &filenames, int includeMask, b
 	{
 		const QModelIndex &mi = *mi_it;
 
-		// FIXME: we are being called once per cell of each row
-		// but we only need column 1. There must be a better way
-		if(mi.column()!=COLUMN_FILENAME)
+		// We are being called once per cell of each row
+		// but we only need one
+		if(mi.column()!=FileTableModel::COLUMN_FILENAME)
 			continue;
 
-		QVariant data = repoFileModel.data(mi, Qt::UserRole+1);
-		QString filename = data.toString();
-		filemap_t::iterator e_it = workspaceFiles.find(filename);
-		Q_ASSERT(e_it!=workspaceFiles.end());
-		const RepoFile &e = *e_it.value();
+		RepoFile e = repoFileModel.getFile(repoFileProxy.mapToSource(mi).row());
+		Q_ASSERT(e.isValid());
 
 		// Skip unwanted files
 		if(!(includeMask & e.getType()))
 			continue;
 
-		filenames.append(filename);
+		filenames.append(e.getFilePath());
 	}
 }
 //------------------------------------------------------------------------------
@@ -1943,7 +1848,25 @@ void MainWindow::loadvcsSettings()
 	if(!runvcs(QStringList() << "settings", &out, RUNGLAGS_SILENT_ALL))
 		return;
 
-	QStringMap kv = MakeKeyValues(out);
+	// Command types we issue directly on vcs
+	outputmap_t command_outputs;
+	for(Settings::mappings_t::iterator it=settings.Mappings.begin(); it!=settings.Mappings.end(); ++it)
+	{
+		if(it->Type != Settings::Setting::TYPE_VCS_COMMAND)
+			continue;
+
+		QStringList cmd_out;
+		if(runvcs(QStringList() << it.key(), &cmd_out, RUNGLAGS_SILENT_ALL))
+			command_outputs.insert(it.key(), cmd_out);
+	}
+
+	applyvcsSettings(out, command_outputs);
+}
+
+//------------------------------------------------------------------------------
+void MainWindow::applyvcsSettings(const QStringList &settingLines, const outputmap_t &commandOutputs)
+{
+	QStringMap kv = MakeKeyValues(settingLines);
 
 	for(Settings::mappings_t::iterator it=settings.Mappings.begin(); it!=settings.Mappings.end(); ++it)
 	{
@@ -1954,13 +1877,13 @@ void MainWindow::loadvcsSettings()
 		if(type == Settings::Setting::TYPE_INTERNAL)
 			continue;
 
-		// Command types we issue directly on vcs
-		if(type == Settings::Setting::TYPE_vcs_COMMAND)
+		// Command types hold the output of the command of the same name
+		if(type == Settings::Setting::TYPE_VCS_COMMAND)
 		{
 			// Retrieve existing url
-			QStringList out;
-			if(runvcs(QStringList() << name, &out, RUNGLAGS_SILENT_ALL) && out.length()==1)
-				it.value().Value = out[0].trimmed();
+			outputmap_t::const_iterator out = commandOutputs.find(name);
+			if(out!=commandOutputs.end() && out->length()==1)
+				it.value().Value = (*out)[0].trimmed();
 
 			continue;
 		}
@@ -2158,7 +2081,7 @@ void MainWindow::on_actionRenameFolder_triggered()
 
 	QString new_path = old_path.left(dir_start) + new_name;
 
-	if(pathSet.contains(new_path))
+	if(workspaceFiles.containsDir(new_path))
 	{
 		QMessageBox::critical(this, tr("Error"), tr("Cannot rename folder.\nThis folder exists already."));
 		return;
@@ -2168,16 +2091,13 @@ void MainWindow::on_actionRenameFolder_triggered()
 	filelist_t files_to_move;
 	QStringList new_paths;
 	QStringList operations;
-	foreach(RepoFile *r, workspaceFiles)
+	workspaceFiles.getSubtreeFiles(old_path, files_to_move);
+	foreach(const RepoFile &r, files_to_move)
 	{
-		if(r->getPath().indexOf(old_path)!=0)
-			continue;
-
-		files_to_move.append(r);
-		QString new_dir = new_path + r->getPath().mid(old_path.length());
+		QString new_dir = new_path + r.getPath().mid(old_path.length());
 		new_paths.append(new_dir);
-		QString new_file_path =  new_dir + PATH_SEP + r->getFilename();
-		operations.append(r->getFilePath() + " -> " + new_file_path);
+		QString new_file_path =  new_dir + PATH_SEP + r.getFilename();
+		operations.append(r.getFilePath() + " -> " + new_file_path);
 	}
 
 	if(files_to_move.empty())
@@ -2195,10 +2115,10 @@ void MainWindow::on_actionRenameFolder_triggered()
 	Q_ASSERT(files_to_move.length() == new_paths.length());
 	for(int i=0; i<files_to_move.length(); ++i)
 	{
-		RepoFile *r = files_to_move[i];
-		const QString &new_file_path = new_paths[i] + PATH_SEP + r->getFilename();
+		const RepoFile &r = files_to_move[i];
+		const QString &new_file_path = new_paths[i] + PATH_SEP + r.getFilename();
 
-		if(!runvcs(QStringList() << "mv" <<  QuotePath(r->getFilePath()) << QuotePath(new_file_path)))
+		if(!runvcs(QStringList() << "mv" <<  QuotePath(r.getFilePath()) << QuotePath(new_file_path)))
 		{
 			log(tr("Move aborted due to errors\n"));
 			goto _exit;
@@ -2231,8 +2151,8 @@ void MainWindow::on_actionRenameFolder_triggered()
 	// Now that target directories exist copy files
 	for(int i=0; i<files_to_move.length(); ++i)
 	{
-		RepoFile *r = files_to_move[i];
-		QString new_file_path = new_paths[i] + PATH_SEP + r->getFilename();
+		const RepoFile &r = files_to_move[i];
+		QString new_file_path = new_paths[i] + PATH_SEP + r.getFilename();
 
 		if(QFile::exists(new_file_path))
 		{
@@ -2240,11 +2160,11 @@ void MainWindow::on_actionRenameFolder_triggered()
 			goto _exit;
 		}
 
-		log(tr("Copying file '")+r->getFilePath()+tr("' to '")+new_file_path+"'\n");
+		log(tr("Copying file '")+r.getFilePath()+tr("' to '")+new_file_path+"'\n");
 
-		if(!QFile::copy(r->getFilePath(), new_file_path))
+		if(!QFile::copy(r.getFilePath(), new_file_path))
 		{
-			QMessageBox::critical(this, tr("Error"), tr("Cannot copy file '%0' to '%1'").arg(r->getFilePath(), new_file_path));
+			QMessageBox::critical(this, tr("Error"), tr("Cannot copy file '%0' to '%1'").arg(r.getFilePath(), new_file_path));
 			goto _exit;
 		}
 	}
@@ -2252,19 +2172,19 @@ void MainWindow::on_actionRenameFolder_triggered()
 	// Finally delete old files
 	for(int i=0; i<files_to_move.length(); ++i)
 	{
-		RepoFile *r = files_to_move[i];
+		const RepoFile &r = files_to_move[i];
 
-		log(tr("Removing old file '")+r->getFilePath()+"'\n");
+		log(tr("Removing old file '")+r.getFilePath()+"'\n");
 
-		if(!QFile::exists(r->getFilePath()))
+		if(!QFile::exists(r.getFilePath()))
 		{
-			QMessageBox::critical(this, tr("Error"), tr("Source file '%0' does not exist").arg(r->getFilePath()));
+			QMessageBox::critical(this, tr("Error"), tr("Source file '%0' does not exist").arg(r.getFilePath()));
 			goto _exit;
 		}
 
-		if(!QFile::remove(r->getFilePath()))
+		if(!QFile::remove(r.getFilePath()))
 		{
-			QMessageBox::critical(this, tr("Error"), tr("Cannot remove file '%0'").arg(r->getFilePath()));
+			QMessageBox::critical(this, tr("Error"), tr("Cannot remove file '%0'").arg(r.getFilePath()));
 			goto _exit;
 		}
 	}
@@ -3,6 +3,7 @@
 
 #include <QMainWindow>
 #include <QStandardItemModel>
+#include <QSortFilterProxyModel>
 #include <QStringList>
 #include <QMap>
 #include <QFileInfo>
@@ -10,6 +11,9 @@
 #include <QProcess>
 #include <QSet>
 #include "SettingsDialog.h"
+#include "FileTable.h"
+#include "FileTableModel.h"
+#include "DirTreeModel.h"
 
 namespace Ui {
     class MainWindow;
@@ -18,96 +22,6 @@ namespace Ui {
 
 class QStringList;
 
-//////////////////////////////////////////////////////////////////////////
-// RepoFile
-//////////////////////////////////////////////////////////////////////////
-struct RepoFile
-{
-	enum EntryType
-	{
-		TYPE_UNKNOWN		= 1<<0,
-		TYPE_UNCHANGED		= 1<<1,
-		TYPE_EDITTED		= 1<<2,
-		TYPE_ADDED			= 1<<3,
-		TYPE_DELETED		= 1<<4,
-		TYPE_MISSING		= 1<<5,
-		TYPE_RENAMED		= 1<<6,
-		TYPE_MODIFIED		= TYPE_EDITTED|TYPE_ADDED|TYPE_DELETED|TYPE_MISSING|TYPE_RENAMED,
-		TYPE_REPO			= TYPE_UNCHANGED|TYPE_MODIFIED,
-		TYPE_ALL			= TYPE_UNKNOWN|TYPE_REPO
-	};
-
-	RepoFile(QFileInfo &info, EntryType type, const QString &repoPath)
-	{
-		FileInfo = info;
-		Type = type;
-		FilePath = getRelativeFilename(repoPath);
-		Path = FileInfo.absolutePath();
-
-		// Strip the workspace path from the path
-		Q_ASSERT(Path.indexOf(repoPath)==0);
-		Path = Path.mid(repoPath.length()+1);
-	}
-
-	bool isType(EntryType t) const
-	{
-		return Type == t;
-	}
-
-	void setType(EntryType t)
-	{
-		Type = t;
-	}
-
-	EntryType getType() const
-	{
-		return Type;
-	}
-
-	QFileInfo getFileInfo() const
-	{
-		return FileInfo;
-	}
-
-	bool isRepo() const
-	{
-		return Type == TYPE_UNCHANGED || Type == TYPE_EDITTED;
-	}
-
-	const QString &getFilePath() const
-	{
-		return FilePath;
-	}
-
-	QString getFilename() const
-	{
-		return FileInfo.fileName();
-	}
-
-	const QString &getPath() const
-	{
-		return Path;
-	}
-
-	QString getRelativeFilename(const QString &path)
-	{
-		QString abs_base_dir = QDir(path).absolutePath();
-
-		QString relative = FileInfo.absoluteFilePath();
-		int index = relative.indexOf(abs_base_dir);
-		if(index<0)
-			return QString("");
-
-		return relative.right(relative.length() - abs_base_dir.length()-1);
-	}
-
-private:
-	QFileInfo	FileInfo;
-	EntryType	Type;
-	QString		FilePath;
-	QString		Path;
-};
-
 //////////////////////////////////////////////////////////////////////////
 // MainWindow
 //////////////////////////////////////////////////////////////////////////
@@ -122,6 +36,7 @@ public:
 
 private:
 	typedef QSet<QString> stringset_t;
+	typedef QMap<QString, QStringList> outputmap_t;
 	enum RunFlags
 	{
 		RUNFLAGS_NONE			= 0<<0,
@@ -134,6 +49,7 @@ private:
 private:
 	bool refresh();
 	void scanWorkspace();
+	void scanWorkspace(const QStringList &statusLines, const QStringList &stashLines);
 	bool runvcs(const QStringList &args, QStringList *output=0, int runFlags=RUNFLAGS_NONE);
 	bool runvcsRaw(const QStringList &args, QStringList *output=0, int *exitCode=0, int runFlags=RUNFLAGS_NONE);
 	void loadSettings();
@@ -146,6 +62,7 @@ private:
 	void getSelectionFilenames(QStringList &filenames, int includeMask=RepoFile::TYPE_ALL, bool allIfEmpty=false);
 	void getFileViewSelection(QStringList &filenames, int includeMask=RepoFile::TYPE_ALL, bool allIfEmpty=false);
 	void getDirViewSelection(QStringList &filenames, int includeMask=RepoFile::TYPE_ALL, bool allIfEmpty=false);
+	static bool isInsideSelectedDir(const QString &path, const stringset_t &dirs);
 	void getStashViewSelection(QStringList &stashNames, bool allIfEmpty=false);
 	void getSelectionPaths(stringset_t &paths);
 	void getAllFilenames(QStringList &filenames, int includeMask=RepoFile::TYPE_ALL);
@@ -156,9 +73,10 @@ private:
 	void rebuildRecent();
 	bool openWorkspace(const QString &path);
 	void loadvcsSettings();
+	void applyvcsSettings(const QStringList &settingLines, const outputmap_t &commandOutputs);
 	QString getvcsPath();
 	QString getvcsHttpAddress();
-	bool scanDirectory(QFileInfoList &entries, const QString& dirPath, const QString &baseDir, const QString ignoreSpec);
+	void cancelScan();
 	void updateDirView();
 	void updateFileView();
 	void updateStashView();
@@ -174,6 +92,8 @@ private:
 	};
 
 	RepoStatus getRepoStatus();
+	RepoStatus parseRepoStatus(const QStringList &infoLines, bool runOk);
+	RepoStatus describeWorkspace(outputmap_t &parts);
 
 	enum ViewMode
 	{
@@ -187,6 +107,8 @@ private slots:
 	void onOpenRecent();
 	void onTreeViewSelectionChanged(const class QItemSelection &selected, const class QItemSelection &deselected);
 	void onFileViewDragOut();
+	void onScanFilesFound(int generation);
+	void onScanDone(int generation);
 
 	// Designer slots
 	void on_actionRefresh_triggered();
@@ -238,13 +160,15 @@ private:
 
 
 	Ui::MainWindow		*ui;
-	QStandardItemModel	repoFileModel;
-	QStandardItemModel	repoDirModel;
+	FileTableModel		repoFileModel;
+	QSortFilterProxyModel	repoFileProxy;
+	DirTreeModel		repoDirModel;
 	QStandardItemModel	repoStashModel;
 	QProcess			vcsUI;
 	QString				vcsUIPort;
 	class QAction		*recentWorkspaceActs[MAX_RECENT];
 	class QProgressBar	*progressBar;
+	class LogConsole	*logConsole;
 	bool				vcsAbort;	// FIXME: No GUI for it yet
 
 	Settings			settings;
@@ -258,11 +182,11 @@ private:
 	class QSettings		*qsettings;
 
 	// Repository State
-	typedef QList<RepoFile*> filelist_t;
-	typedef QMap<QString, RepoFile*> filemap_t;
+	typedef QVector<RepoFile> filelist_t;
 	typedef QMap<QString, QString> stashmap_t;
-	filemap_t			workspaceFiles;
-	stringset_t			pathSet;
+	FileTable			workspaceFiles;
+	class WorkspaceScanner	*scanner;	// The scan in progress, if any
+	int					scanGeneration;	// Identifies the latest scan
 	stashmap_t			stashMap;
 };
 
@@ -0,0 +1,185 @@
+#include "WorkspaceScanner.h"
+#include <QDir>
+
+#define PATH_SEP			"/"
+
+///////////////////////////////////////////////////////////////////////////////
+WorkspaceScanner::WorkspaceScanner(int generation, const QString &workspace, const QStringList &statusLines,
+								   bool scanFiles, bool showModified, bool showUnchanged,
+								   const QString &ignoreSpec, QObject *parent) :
+	QThread(parent),
+	generation(generation),
+	workspace(workspace),
+	scanFiles(scanFiles),
+	showModified(showModified),
+	showUnchanged(showUnchanged),
+	ignore(ignoreSpec),
+	canceled(0),
+	statusLines(statusLines)
+{
+}
+
+//------------------------------------------------------------------------------
+WorkspaceScanner::~WorkspaceScanner()
+{
+	Q_ASSERT(!isRunning());
+}
+
+//------------------------------------------------------------------------------
+void WorkspaceScanner::takeResults(filelist_t &files)
+{
+	QMutexLocker lck(&mutex);
+	files += results;
+	results.clear();
+}
+
+//------------------------------------------------------------------------------
+void WorkspaceScanner::parseStatus(const QStringList &lines)
+{
+	for(QStringList::const_iterator line_it=lines.begin(); line_it!=lines.end(); ++line_it)
+	{
+		QString line = (*line_it).trimmed();
+		if(line.length()==0)
+			continue;
+
+		QString status_text = line.left(10).trimmed();
+		QString fname = line.right(line.length() - 10).trimmed();
+		RepoFile::EntryType type = RepoFile::TYPE_UNKNOWN;
+
+		if(status_text=="EDITED")
+			type = RepoFile::TYPE_EDITTED;
+		else if(status_text=="ADDED")
+			type = RepoFile::TYPE_ADDED;
+		else if(status_text=="DELETED")
+			type = RepoFile::TYPE_DELETED;
+		else if(status_text=="MISSING")
+			type = RepoFile::TYPE_MISSING;
+		else if(status_text=="RENAMED")
+			type = RepoFile::TYPE_RENAMED;
+		else if(status_text=="UNCHANGED")
+			type = RepoFile::TYPE_UNCHANGED;
+
+		// Filter unwanted file types
+		if( ((type & RepoFile::TYPE_MODIFIED) && !showModified) ||
+			((type & RepoFile::TYPE_UNCHANGED) && !showUnchanged ))
+		{
+			hiddenSet.insert(fname);
+			continue;
+		}
+
+		statusMap.insert(fname, type);
+	}
+}
+
+//------------------------------------------------------------------------------
+void WorkspaceScanner::run()
+{
+	batchTime.start();
+
+	// Parse here rather than in the constructor so that it is off the UI thread
+	parseStatus(statusLines);
+	statusLines.clear();
+
+	if(scanFiles)
+		scanDirectory(workspace);
+
+	// Every repository file found on disk has been removed from the
+	// status map. Report the rest, which is all of them if we skipped
+	// scanning the workspace
+	for(statusmap_t::iterator it=statusMap.begin(); it!=statusMap.end() && !isCanceled(); ++it)
+	{
+		const QString &file_path = it.key();
+		int sep = file_path.lastIndexOf(PATH_SEP);
+		QString path = sep==-1 ? QString("") : file_path.left(sep);
+		addFile(path, file_path.mid(sep+1), it.value());
+	}
+
+	flush(true);
+	emit scanDone(generation);
+}
+
+//------------------------------------------------------------------------------
+bool WorkspaceScanner::scanDirectory(const QString &dirPath)
+{
+	QDir dir(dirPath);
+	QString base_prefix = workspace + PATH_SEP;
+
+	// All files of the folder share one copy of its path
+	QString dir_rel_path = dirPath.length()>base_prefix.length() ? dirPath.mid(base_prefix.length()) : QString("");
+
+	QFileInfoList list = dir.entryInfoList(QDir::Dirs | QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot);
+	for (int i=0; i<list.count(); ++i)
+	{
+		if(isCanceled())
+			return false;
+
+		QFileInfo &info = list[i];
+		QString filepath = info.filePath();
+		QString rel_path = filepath.mid(base_prefix.length());
+
+		if (info.isDir())
+		{
+			// Skip ignored directories along with everything in them
+			if(!ignore.isEmpty() && ignore.matchDir(rel_path))
+				continue;
+
+			if(!scanDirectory(filepath))
+				return false;
+			continue;
+		}
+
+		// Skip ignored files
+		if(!ignore.isEmpty() && ignore.match(rel_path))
+			continue;
+
+		// Skip repository files of types we do not show
+		if(hiddenSet.contains(rel_path))
+			continue;
+
+		RepoFile::EntryType type = RepoFile::TYPE_UNKNOWN;
+		statusmap_t::iterator it = statusMap.find(rel_path);
+		if(it!=statusMap.end())
+		{
+			type = it.value();
+			statusMap.erase(it);
+		}
+
+		addFile(dir_rel_path, info.fileName(), type);
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------------
+void WorkspaceScanner::addFile(const QString &path, const QString &name, RepoFile::EntryType type)
+{
+	ScannedFile f;
+	f.Path = path;
+	f.Name = name;
+	f.Type = type;
+	batch.append(f);
+	flush(false);
+}
+
+//------------------------------------------------------------------------------
+void WorkspaceScanner::flush(bool force)
+{
+	if(batch.empty())
+		return;
+
+	if(!force && batch.size()<BATCH_SIZE && batchTime.elapsed()<BATCH_MSEC)
+		return;
+
+	bool notify;
+	{
+		QMutexLocker lck(&mutex);
+		// Only signal if the receiver has collected the previous batch,
+		// otherwise it will collect this one along with it
+		notify = results.empty();
+		results += batch;
+	}
+	batch.clear();
+	batchTime.restart();
+
+	if(notify)
+		emit filesFound(generation);
+}
@@ -0,0 +1,81 @@
+#ifndef WORKSPACESCANNER_H
+#define WORKSPACESCANNER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QHash>
+#include <QStringList>
+#include <QFileInfo>
+#include <QTime>
+#include <QSet>
+#include "FileTable.h"
+#include "GlobMatcher.h"
+
+//////////////////////////////////////////////////////////////////////////
+// WorkspaceScanner
+// Walks the workspace and merges it with the output of "ls -l" on a
+// worker thread. The files it finds are handed over in batches:
+// filesFound() is emitted when new files are waiting and the receiver
+// collects them with takeResults().
+//////////////////////////////////////////////////////////////////////////
+class WorkspaceScanner : public QThread
+{
+	Q_OBJECT
+public:
+	struct ScannedFile
+	{
+		QString				Path;	// Folder, shared by all files in it
+		QString				Name;
+		RepoFile::EntryType	Type;
+	};
+	typedef QVector<ScannedFile> filelist_t;
+
+	WorkspaceScanner(int generation, const QString &workspace, const QStringList &statusLines,
+					 bool scanFiles, bool showModified, bool showUnchanged,
+					 const QString &ignoreSpec, QObject *parent = 0);
+	~WorkspaceScanner();
+
+	void cancel() { canceled = 1; }
+	bool isCanceled() const { return canceled != 0; }
+	void takeResults(filelist_t &files);
+
+signals:
+	void filesFound(int generation);
+	void scanDone(int generation);
+
+protected:
+	void run();
+
+private:
+	typedef QHash<QString, RepoFile::EntryType> statusmap_t;
+
+	void parseStatus(const QStringList &lines);
+	bool scanDirectory(const QString &dirPath);
+	void addFile(const QString &path, const QString &name, RepoFile::EntryType type);
+	void flush(bool force);
+
+	enum
+	{
+		BATCH_SIZE		= 512,	// Hand over at least this many files...
+		BATCH_MSEC		= 100	// ...or whatever was found in this time
+	};
+
+	int					generation;
+	QString				workspace;
+	bool				scanFiles;
+	bool				showModified;
+	bool				showUnchanged;
+	GlobMatcher			ignore;
+	QAtomicInt			canceled;
+
+	QStringList			statusLines;	// Output of "ls -l", parsed by run()
+	statusmap_t			statusMap;	// Files known to the repository
+	QSet<QString>		hiddenSet;	// Repository files filtered out by the view
+	filelist_t			batch;		// Files found since the last flush
+	QTime				batchTime;
+
+	QMutex				mutex;		// Protects results
+	filelist_t			results;	// Files waiting to be taken
+};
+
+#endif // WORKSPACESCANNER_H
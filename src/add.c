@@ -75,52 +75,89 @@ const char *vcs_all_reserved_names(void){
 }
 
 /*
-** Add a single file named zName to the VFILE table with vid.
-**
-** Omit any file whose name is pOmit.
+** State shared by every add_one_file() call of a single add operation.
+** The statements are prepared once and the ADDED and SKIP lines are
+** collected in a buffer that is written out in large pieces.
+*/
+typedef struct AddCtx AddCtx;
+struct AddCtx {
+  int vid;             /* Add to this VFILE */
+  int quiet;           /* Do not list the files added or skipped */
+  Stmt qExists;        /* Is a name already in VFILE? */
+  Stmt qUndelete;      /* Clear the deleted flag of a name in VFILE */
+  Stmt qInsert;        /* Insert a new name into VFILE */
+  Blob out;            /* Output not yet printed */
+};
+
+/*
+** Print whatever output of an add operation has been buffered.
+*/
+static void add_flush_output(AddCtx *p){
+  if( blob_size(&p->out)>0 ){
+    vcs_print("%s", blob_str(&p->out));
+    blob_reset(&p->out);
+  }
+}
+
+/*
+** Add a single file named zPath to the VFILE table.  perm is the PERM_*
+** value of the file, or -1 if it is not yet known.
 */
 static int add_one_file(
+  AddCtx *p,           /* The add operation */
   const char *zPath,   /* Tree-name of file to add. */
-  int vid,             /* Add to this VFILE */
-  int caseSensitive    /* True if filenames are case sensitive */
+  int perm             /* PERM_* of the file or -1 */
 ){
-  const char *zCollate = caseSensitive ? "binary" : "nocase";
+  int nChange;
   if( !file_is_simple_pathname(zPath) ){
     vcs_fatal("filename contains illegal characters: %s", zPath);
   }
-  if( db_exists("SELECT 1 FROM vfile"
-                " WHERE pathname=%Q COLLATE %s", zPath, zCollate) ){
-    db_multi_exec("UPDATE vfile SET deleted=0"
-                  " WHERE pathname=%Q COLLATE %s", zPath, zCollate);
+  db_bind_text(&p->qExists, ":path", zPath);
+  if( db_step(&p->qExists)==SQLITE_ROW ){
+    db_reset(&p->qExists);
+    db_bind_text(&p->qUndelete, ":path", zPath);
+    db_step(&p->qUndelete);
+    db_reset(&p->qUndelete);
   }else{
-    char *zFullname = mprintf("%s%s", g.zLocalRoot, zPath);
-    db_multi_exec(
-      "INSERT INTO vfile(vid,deleted,rid,mrid,pathname,isexe,islink)"
-      "VALUES(%d,0,0,0,%Q,%d,%d)",
-      vid, zPath, file_wd_isexe(zFullname), file_wd_islink(zFullname));
-    vcs_free(zFullname);
+    db_reset(&p->qExists);
+    if( perm<0 ){
+      char *zFullname = mprintf("%s%s", g.zLocalRoot, zPath);
+      perm = file_wd_perm(zFullname);
+      vcs_free(zFullname);
+    }
+    db_bind_int(&p->qInsert, ":vid", p->vid);
+    db_bind_text(&p->qInsert, ":path", zPath);
+    db_bind_int(&p->qInsert, ":isexe", perm==PERM_EXE);
+    db_bind_int(&p->qInsert, ":islink", perm==PERM_LNK);
+    db_step(&p->qInsert);
+    db_reset(&p->qInsert);
   }
-  if( db_changes() ){
-    vcs_print("ADDED  %s\n", zPath);
-    return 1;
-  }else{
-    vcs_print("SKIP   %s\n", zPath);
-    return 0;
+  nChange = db_changes();
+  if( !p->quiet ){
+    blob_appendf(&p->out, "%s%s\n", nChange ? "ADDED  " : "SKIP   ", zPath);
+    if( blob_size(&p->out)>=16384 ) add_flush_output(p);
   }
+  return nChange!=0;
 }
 
 /*
-** Add all files in the sfile temp table.
+** Add all files in the sfile temp table.  If the PERM column of
+** sfile is not NULL, it is the PERM_* of the file as seen by the scan.
 **
-** Automatically exclude the repository file.
+** Automatically exclude the repository file and the names reserved by
+** vcs.  Those are checked here in memory, so the only SQL run for each
+** file is a handful of statements that are prepared once.
 */
-static int add_files_in_sfile(int vid, int caseSensitive){
+static int add_files_in_sfile(int vid, int caseSensitive, int quiet){
+  const char *zCollate;     /* Collating sequence for names */
   const char *zRepo;        /* Name of the repository database file */
   int nAdd = 0;             /* Number of files added */
+  int nReserved;            /* Number of reserved names */
   int i;                    /* Loop counter */
-  const char *zReserved;    /* Name of a reserved file */
+  const char *azReserved[20]; /* Names of the reserved files */
   Blob repoName;            /* Treename of the repository */
   Stmt loop;                /* SQL to loop over all files to add */
+  AddCtx ctx;               /* Statements shared by add_one_file() calls */
   int (*xCmp)(const char*,const char*);
  
   if( !file_tree_name(g.zRepositoryName, &repoName, 0) ){
@@ -131,24 +168,49 @@ static int add_files_in_sfile(int vid, int caseSensitive){
   }
   if( caseSensitive ){
     xCmp = vcs_strcmp;
+    zCollate = "binary";
   }else{
     xCmp = vcs_stricmp;
+    zCollate = "nocase";
     db_multi_exec(
       "CREATE INDEX IF NOT EXISTS vfile_nocase"
       "    ON vfile(pathname COLLATE nocase)"
     );
   }
-  db_prepare(&loop, "SELECT x FROM sfile ORDER BY x");
+  nReserved = 0;
+  while( nReserved<(int)count(azReserved)
+      && (azReserved[nReserved] = vcs_reserved_name(nReserved))!=0 ){
+    nReserved++;
+  }
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.vid = vid;
+  ctx.quiet = quiet;
+  blob_zero(&ctx.out);
+  db_prepare(&ctx.qExists,
+    "SELECT 1 FROM vfile WHERE pathname=:path COLLATE %s", zCollate);
+  db_prepare(&ctx.qUndelete,
+    "UPDATE vfile SET deleted=0 WHERE pathname=:path COLLATE %s", zCollate);
+  db_prepare(&ctx.qInsert,
+    "INSERT INTO vfile(vid,deleted,rid,mrid,pathname,isexe,islink)"
+    "VALUES(:vid,0,0,0,:path,:isexe,:islink)");
+
+  db_prepare(&loop, "SELECT x, coalesce(perm,-1) FROM sfile ORDER BY x");
   while( db_step(&loop)==SQLITE_ROW ){
     const char *zToAdd = db_column_text(&loop, 0);
+    int perm = db_column_int(&loop, 1);
     if( vcs_strcmp(zToAdd, zRepo)==0 ) continue;
-    for(i=0; (zReserved = vcs_reserved_name(i))!=0; i++){
-      if( xCmp(zToAdd, zReserved)==0 ) break;
+    for(i=0; i<nReserved; i++){
+      if( xCmp(zToAdd, azReserved[i])==0 ) break;
     }
-    if( zReserved ) continue;
-    nAdd += add_one_file(zToAdd, vid, caseSensitive);
+    if( i<nReserved ) continue;
+    nAdd += add_one_file(&ctx, zToAdd, perm);
   }
   db_finalize(&loop);
+  db_finalize(&ctx.qExists);
+  db_finalize(&ctx.qUndelete);
+  db_finalize(&ctx.qInsert);
+  add_flush_output(&ctx);
   blob_reset(&repoName);
   return nAdd;
 }
@@ -158,6 +220,11 @@ static int add_files_in_sfile(int vid, int caseSensitive){
 **
 ** Usage: %vcs add ?OPTIONS? FILE1 ?FILE2 ...?
 **
+** Options:
+**    --dotfiles       include files whose names begin with "."
+**    --ignore GLOBS   ignore files matching these comma-separated patterns
+**    --quiet|-q       do not list each file as it is added
+**
 */
 void add_cmd(void){
   int i;                     /* Loop counter */
@@ -166,9 +233,12 @@ void add_cmd(void){
   const char *zIgnoreFlag;   /* The --ignore option or ignore-glob setting */
   Glob *pIgnore;             /* Ignore everything matching this glob pattern */
   int caseSensitive;         /* True if filenames are case sensitive */
+  int quiet;                 /* Do not list the files added */
+  unsigned scanFlags;        /* SCAN_* flags for vfile_scan() */
 
   zIgnoreFlag = find_option("ignore",0,1);
   includeDotFiles = find_option("dotfiles",0,0)!=0;
+  quiet = find_option("quiet","q",0)!=0;
   capture_case_sensitive_option();
   db_must_be_within_tree();
   caseSensitive = filenames_are_case_sensitive();
@@ -180,7 +250,7 @@ void add_cmd(void){
     vcs_panic("no checkout to add to");
   }
   db_begin_transaction();
-  db_multi_exec("CREATE TEMP TABLE sfile(x TEXT PRIMARY KEY)");
+  db_multi_exec("CREATE TEMP TABLE sfile(x TEXT PRIMARY KEY, perm INT)");
 #if defined(_WIN32)
   db_multi_exec(
      "CREATE INDEX IF NOT EXISTS vfile_pathname "
@@ -189,6 +259,7 @@ void add_cmd(void){
 #endif
   pIgnore = glob_create(zIgnoreFlag);
   nRoot = strlen(g.zLocalRoot);
+  scanFlags = SCAN_PERM | (includeDotFiles ? SCAN_ALL : 0);
   
   /* Load the names of all files that are to be added into sfile temp table */
   for(i=2; i<g.argc; i++){
@@ -200,7 +271,7 @@ void add_cmd(void){
     zName = blob_str(&fullName);
     isDir = file_wd_isdir(zName);
     if( isDir==1 ){
-      vfile_scan(&fullName, nRoot-1, includeDotFiles, pIgnore);
+      vfile_scan(&fullName, nRoot-1, scanFlags, pIgnore);
     }else if( isDir==0 ){
       vcs_fatal("not found: %s", zName);
     }else if( file_access(zName, R_OK) ){
@@ -216,7 +287,7 @@ void add_cmd(void){
   }
   glob_free(pIgnore);
 
-  add_files_in_sfile(vid, caseSensitive);
+  add_files_in_sfile(vid, caseSensitive, quiet);
   db_end_transaction(0);
 }
 
@@ -0,0 +1,194 @@
+/*
+** This file implements a bump allocator for short-lived memory.
+**
+** Loops that visit every file of a checkout tend to build a few small
+** strings for each file, such as its full pathname, and free them again
+** before moving on to the next file.  Taking that memory from an Arena
+** rather than from malloc() makes each allocation a pointer bump.  All
+** the memory of one iteration is given back at once by rewinding the
+** arena to a mark taken at the top of the loop.
+**
+** Memory from an arena must not be passed to free() and must not be
+** used after the arena has been rewound past it.
+*/
+#include "config.h"
+#include "arena.h"
+
+#if INTERFACE
+/*
+** A block of memory that an Arena hands out allocations from.  The
+** memory itself follows the header.
+*/
+struct ArenaChunk {
+  ArenaChunk *pNext;     /* Next chunk.  Chunks past pCur are unused */
+  size_t nSize;          /* Bytes of memory in the chunk */
+  size_t nUsed;          /* Bytes handed out */
+};
+
+/*
+** An arena.  Zero it with arena_init() before use.
+*/
+struct Arena {
+  ArenaChunk *pFirst;    /* First chunk */
+  ArenaChunk *pCur;      /* Chunk that allocations come from */
+  Blob scratch;          /* Reused to format text for arena_mprintf() */
+  i64 nInUse;            /* Bytes handed out and not rewound */
+  i64 nAlloc;            /* Number of allocations */
+  i64 nByte;             /* Bytes handed out, including rewound ones */
+  i64 nPeak;             /* Largest value of nInUse */
+  int nChunk;            /* Chunks obtained from malloc() */
+};
+
+/*
+** A position in an arena to rewind to.
+*/
+struct ArenaMark {
+  ArenaChunk *pChunk;    /* Current chunk when the mark was taken */
+  size_t nUsed;          /* Bytes used in that chunk */
+  i64 nInUse;            /* Arena.nInUse when the mark was taken */
+};
+
+/*
+** Default size of an arena chunk.  Larger allocations get a chunk of
+** their own size.
+*/
+#define ARENA_CHUNK 65536
+#endif /* INTERFACE */
+
+/*
+** The arena shared by the whole of the current command.
+*/
+static Arena cmdArena;
+static int cmdArenaInit = 0;
+
+/*
+** Initialize an arena.  Any prior content is discarded, not freed.
+*/
+void arena_init(Arena *p){
+  memset(p, 0, sizeof(*p));
+  blob_zero(&p->scratch);
+}
+
+/*
+** Return the arena of the current command.
+*/
+Arena *arena_default(void){
+  if( !cmdArenaInit ){
+    arena_init(&cmdArena);
+    cmdArenaInit = 1;
+  }
+  return &cmdArena;
+}
+
+/*
+** Move an arena on to a chunk with room for n bytes.  The chunk after
+** the current one is reused if it is large enough.  Otherwise a new
+** chunk is allocated and linked in after the current one.
+*/
+static ArenaChunk *arena_next_chunk(Arena *p, size_t n){
+  ArenaChunk *pNext = p->pCur ? p->pCur->pNext : p->pFirst;
+  if( pNext==0 || pNext->nSize<n ){
+    size_t nSize = n>ARENA_CHUNK ? n : ARENA_CHUNK;
+    ArenaChunk *pNew = vcs_malloc( sizeof(ArenaChunk) + nSize );
+    pNew->nSize = nSize;
+    pNew->pNext = pNext;
+    if( p->pCur ){
+      p->pCur->pNext = pNew;
+    }else{
+      p->pFirst = pNew;
+    }
+    p->nChunk++;
+    pNext = pNew;
+  }
+  pNext->nUsed = 0;
+  p->pCur = pNext;
+  return pNext;
+}
+
+/*
+** Allocate n bytes from an arena.  The memory is aligned to 8 bytes.
+*/
+void *arena_alloc(Arena *p, size_t n){
+  ArenaChunk *pChunk = p->pCur;
+  char *z;
+  n = (n+7) & ~(size_t)7;
+  if( pChunk==0 || pChunk->nUsed+n>pChunk->nSize ){
+    pChunk = arena_next_chunk(p, n);
+  }
+  z = (char*)&pChunk[1] + pChunk->nUsed;
+  pChunk->nUsed += n;
+  p->nAlloc++;
+  p->nByte += n;
+  p->nInUse += n;
+  if( p->nInUse>p->nPeak ) p->nPeak = p->nInUse;
+  return z;
+}
+
+/*
+** Like mprintf() but the string is allocated from arena p.
+*/
+char *arena_mprintf(Arena *p, const char *zFormat, ...){
+  va_list ap;
+  char *z;
+  i64 n;
+  blob_resize(&p->scratch, 0);
+  va_start(ap, zFormat);
+  vxprintf(&p->scratch, zFormat, ap);
+  va_end(ap);
+  n = blob_size(&p->scratch);
+  z = arena_alloc(p, n+1);
+  memcpy(z, blob_buffer(&p->scratch), n);
+  z[n] = 0;
+  return z;
+}
+
+/*
+** Return a mark of the current position of an arena.
+*/
+ArenaMark arena_mark(Arena *p){
+  ArenaMark mark;
+  mark.pChunk = p->pCur;
+  mark.nUsed = p->pCur ? p->pCur->nUsed : 0;
+  mark.nInUse = p->nInUse;
+  return mark;
+}
+
+/*
+** Give back everything allocated from an arena since mark was taken.
+** The chunks stay allocated for reuse.
+*/
+void arena_rewind(Arena *p, ArenaMark mark){
+  ArenaChunk *pChunk;
+  p->pCur = mark.pChunk ? mark.pChunk : p->pFirst;
+  if( p->pCur ){
+    p->pCur->nUsed = mark.pChunk ? mark.nUsed : 0;
+    for(pChunk=p->pCur->pNext; pChunk; pChunk=pChunk->pNext){
+      pChunk->nUsed = 0;
+    }
+  }
+  p->nInUse = mark.nInUse;
+}
+
+/*
+** Free all the memory of an arena.  The counters are kept.
+*/
+void arena_clear(Arena *p){
+  ArenaChunk *pChunk, *pNext;
+  for(pChunk=p->pFirst; pChunk; pChunk=pNext){
+    pNext = pChunk->pNext;
+    free(pChunk);
+  }
+  p->pFirst = p->pCur = 0;
+  p->nInUse = 0;
+  blob_reset(&p->scratch);
+}
+
+/*
+** Print the counters of the command arena on stderr.
+*/
+void arena_print_stats(void){
+  Arena *p = arena_default();
+  fprintf(stderr,
+    "arena allocations: %lld  bytes: %lld  peak: %lld  chunks: %d\n",
+    p->nAlloc, p->nByte, p->nPeak, p->nChunk);
+}
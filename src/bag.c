@@ -13,17 +13,30 @@
 ** An integer can appear in the bag at most once.
 ** Integers must be positive.
 **
-** On a hash collision, search continues to the next slot in the array,
-** looping back to the beginning of the array when we reach the end.
-** The search stops when a match is found or upon encountering a 0 entry.
+** A bag has two representations.  The default is an open-addressing
+** hash table whose size is always a power of two.  On a hash collision,
+** search continues to the next slot in the array, looping back to the
+** beginning of the array when we reach the end.  The search stops when
+** a match is found or upon encountering a 0 entry.  When an entry is
+** deleted, its value is changed to -1.
 **
-** When an entry is deleted, its value is changed to -1.
+** A bag initialized with bag_init_dense() instead uses a bitmap with
+** one bit for every integer up to the largest ever inserted.  That is
+** smaller and faster when the elements are mostly-contiguous rids.
+**
+** In either representation, iFirst is a slot (or bitmap word) before
+** which there are known to be no elements.  It lets bag_first() and
+** bag_pop() avoid rescanning the front of the table.
 */
 struct Bag {
-  int cnt;   /* Number of integers in the bag */
-  int sz;    /* Number of slots in a[] */
-  int used;  /* Number of used slots in a[] */
-  int *a;    /* Hash table of integers that are in the bag */
+  int cnt;             /* Number of integers in the bag */
+  int sz;              /* Number of slots in a[].  Zero or a power of 2 */
+  int used;            /* Number of used slots in a[] */
+  int *a;              /* Hash table of integers that are in the bag */
+  int iFirst;          /* No elements before this slot or word */
+  int nWord;           /* Number of words in aBit[] */
+  unsigned int *aBit;  /* Dense mode: bit e is set if e is in the bag */
+  u8 isDense;          /* True to use aBit[] instead of a[] */
 };
 #endif
 
@@ -35,24 +48,45 @@ void bag_init(Bag *p){
 }
 
 /*
-** Destroy a Bag.  Delete all of its content.
+** Initialize a Bag structure that uses the dense-bitmap representation.
+*/
+void bag_init_dense(Bag *p){
+  memset(p, 0, sizeof(*p));
+  p->isDense = 1;
+}
+
+/*
+** Destroy a Bag.  Delete all of its content.  The representation
+** chosen when the bag was initialized is kept.
 */
 void bag_clear(Bag *p){
+  u8 isDense = p->isDense;
   free(p->a);
+  free(p->aBit);
   bag_init(p);
+  p->isDense = isDense;
 }
 
 /*
-** The hash function
+** The hash function.  This is the 32-bit finalizer from MurmurHash3,
+** which spreads runs of consecutive integers across the whole table.
 */
-#define bag_hash(i)  (i*101)
+static unsigned int bag_hash(int e){
+  unsigned int h = (unsigned int)e;
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
 
 /*
 ** Change the size of the hash table on a bag so that
-** it contains N slots
+** it contains N slots.  N must be a power of two.
 **
 ** Completely reconstruct the hash table from scratch.  Deleted
-** entries (indicated by a -1) are removed.  When finished, it 
+** entries (indicated by a -1) are removed.  When finished, it
 ** should be the case that p->cnt==p->used.
 */
 static void bag_resize(Bag *p, int newSize){
@@ -60,19 +94,21 @@ static void bag_resize(Bag *p, int newSize){
   Bag old;
   int nDel = 0;   /* Number of deleted entries */
   int nLive = 0;  /* Number of live entries */
+  unsigned int mask = newSize - 1;
 
   old = *p;
   assert( newSize>old.cnt );
+  assert( (newSize & mask)==0 );
   p->a = vcs_malloc( sizeof(p->a[0])*newSize );
   p->sz = newSize;
+  p->iFirst = 0;
   memset(p->a, 0, sizeof(p->a[0])*newSize );
   for(i=0; i<old.sz; i++){
     int e = old.a[i];
     if( e>0 ){
-      unsigned h = bag_hash(e)%newSize;
+      unsigned h = bag_hash(e) & mask;
       while( p->a[h] ){
-        h++;
-        if( h==newSize ) h = 0;
+        h = (h+1) & mask;
       }
       p->a[h] = e;
       nLive++;
@@ -83,7 +119,60 @@ static void bag_resize(Bag *p, int newSize){
   assert( p->cnt == nLive );
   assert( p->used == nLive+nDel );
   p->used = p->cnt;
-  bag_clear(&old);
+  free(old.a);
+}
+
+/*
+** Make sure the bitmap of a dense bag has room for element e.
+*/
+static void bag_dense_grow(Bag *p, int e){
+  int iWord = e>>5;
+  if( iWord>=p->nWord ){
+    int nNew = p->nWord*2;
+    if( nNew<=iWord ) nNew = iWord + 64;
+    p->aBit = vcs_realloc(p->aBit, sizeof(p->aBit[0])*nNew);
+    memset(&p->aBit[p->nWord], 0, sizeof(p->aBit[0])*(nNew - p->nWord));
+    p->nWord = nNew;
+  }
+}
+
+/*
+** Return the smallest element of a dense bag that is greater than
+** or equal to e, or 0 if there is no such element.
+*/
+static int bag_dense_next(Bag *p, int e){
+  int iWord = e>>5;
+  unsigned int w;
+  if( iWord>=p->nWord ) return 0;
+  w = p->aBit[iWord] & (0xffffffffu << (e&31));
+  while( w==0 ){
+    if( ++iWord>=p->nWord ) return 0;
+    w = p->aBit[iWord];
+  }
+  for(e=0; (w & (1u<<e))==0; e++){}
+  return iWord*32 + e;
+}
+
+/*
+** Make sure the hash table of a bag can accept nNew more inserts
+** without being resized.  Tables that are mostly tombstones are
+** rebuilt at their current size rather than doubled.
+*/
+static void bag_reserve_slots(Bag *p, int nNew){
+  int n;
+  if( (p->used+nNew)*2 < p->sz ) return;
+  n = p->sz ? p->sz : 16;
+  while( (p->cnt+nNew)*2 >= n ) n *= 2;
+  bag_resize(p, n);
+}
+
+/*
+** Make sure the bag can hold at least N more elements without
+** further reallocation.  This is an optimization only.
+*/
+void bag_reserve(Bag *p, int N){
+  if( N<=0 || p->isDense ) return;
+  bag_reserve_slots(p, N);
 }
 
 /*
@@ -93,72 +182,124 @@ static void bag_resize(Bag *p, int newSize){
 */
 int bag_insert(Bag *p, int e){
   unsigned h;
+  unsigned mask;
   int rc = 0;
   assert( e>0 );
+  if( p->isDense ){
+    unsigned int m = 1u<<(e&31);
+    bag_dense_grow(p, e);
+    if( (p->aBit[e>>5] & m)!=0 ) return 0;
+    p->aBit[e>>5] |= m;
+    if( p->cnt==0 || (e>>5)<p->iFirst ) p->iFirst = e>>5;
+    p->cnt++;
+    return 1;
+  }
   if( p->used+1 >= p->sz/2 ){
-    int n = p->sz*2;
-    bag_resize(p,  n + 20 );
+    bag_reserve_slots(p, 1);
   }
-  h = bag_hash(e)%p->sz;
+  mask = p->sz - 1;
+  h = bag_hash(e) & mask;
   while( p->a[h]>0 && p->a[h]!=e ){
-    h++;
-    if( h>=p->sz ) h = 0;
+    h = (h+1) & mask;
   }
   if( p->a[h]<=0 ){
+    /* The element might still be further along the probe sequence if
+    ** a[h] is a tombstone.  Check before reusing the slot. */
+    if( p->a[h]<0 ){
+      unsigned h2 = (h+1) & mask;
+      while( p->a[h2] && p->a[h2]!=e ) h2 = (h2+1) & mask;
+      if( p->a[h2]==e ) return 0;
+    }
     if( p->a[h]==0 ) p->used++;
     p->a[h] = e;
     p->cnt++;
+    if( h<(unsigned)p->iFirst ) p->iFirst = h;
     rc = 1;
   }
   return rc;
 }
 
+/*
+** Insert the N elements of array aE[] into the bag.  Return the number
+** of elements that were not already present.
+*/
+int bag_insert_array(Bag *p, const int *aE, int N){
+  int i;
+  int nIns = 0;
+  bag_reserve(p, N);
+  for(i=0; i<N; i++){
+    nIns += bag_insert(p, aE[i]);
+  }
+  return nIns;
+}
+
 /*
 ** Return true if e in the bag.  Return false if it is no.
 */
 int bag_find(Bag *p, int e){
   unsigned h;
+  unsigned mask;
   assert( e>0 );
+  if( p->isDense ){
+    return (e>>5)<p->nWord && (p->aBit[e>>5] & (1u<<(e&31)))!=0;
+  }
   if( p->sz==0 ){
     return 0;
   }
-  h = bag_hash(e)%p->sz;
+  mask = p->sz - 1;
+  h = bag_hash(e) & mask;
   while( p->a[h] && p->a[h]!=e ){
-    h++;
-    if( h>=p->sz ) h = 0;
+    h = (h+1) & mask;
   }
   return p->a[h]==e;
 }
 
+/*
+** Remove the element in slot h of the hash table.
+*/
+static void bag_remove_slot(Bag *p, unsigned h){
+  unsigned nx = (h+1) & (p->sz-1);
+  assert( p->a[h]>0 );
+  if( p->a[nx]==0 ){
+    p->a[h] = 0;
+    p->used--;
+  }else{
+    p->a[h] = -1;
+  }
+  p->cnt--;
+  if( p->cnt==0 ){
+    memset(p->a, 0, p->sz*sizeof(p->a[0]));
+    p->used = 0;
+    p->iFirst = 0;
+  }else if( p->sz>64 && p->cnt<p->sz/8 ){
+    bag_resize(p, p->sz/2);
+  }
+}
+
 /*
 ** Remove element e from the bag if it exists in the bag.
 ** If e is not in the bag, this is a no-op.
 */
 void bag_remove(Bag *p, int e){
   unsigned h;
+  unsigned mask;
   assert( e>0 );
+  if( p->isDense ){
+    unsigned int m = 1u<<(e&31);
+    if( (e>>5)<p->nWord && (p->aBit[e>>5] & m)!=0 ){
+      p->aBit[e>>5] &= ~m;
+      p->cnt--;
+    }
+    return;
+  }
   if( p->sz==0 ) return;
-  h = bag_hash(e)%p->sz;
+  mask = p->sz - 1;
+  h = bag_hash(e) & mask;
   while( p->a[h] && p->a[h]!=e ){
-    h++;
-    if( h>=p->sz ) h = 0;
+    h = (h+1) & mask;
   }
   if( p->a[h] ){
-    int nx = h+1;
-    if( nx>=p->sz ) nx = 0;
-    if( p->a[nx]==0 ){
-      p->a[h] = 0;
-      p->used--;
-    }else{
-      p->a[h] = -1;
-    }
-    p->cnt--;
-    if( p->cnt==0 ){
-      memset(p->a, 0, p->sz*sizeof(p->a[0]));
-      p->used = 0;
-    }else if( p->sz>40 && p->cnt<p->sz/8 ){
-      bag_resize(p, p->sz/2);
-    }
+    bag_remove_slot(p, h);
   }
 }
 
@@ -168,12 +309,33 @@ void bag_remove(Bag *p, int e){
 */
 int bag_first(Bag *p){
   int i;
-  for(i=0; i<p->sz && p->a[i]<=0; i++){}
-  if( i<p->sz ){
-    return p->a[i];
+  if( p->cnt==0 ) return 0;
+  if( p->isDense ){
+    i = bag_dense_next(p, p->iFirst*32);
+    p->iFirst = i>>5;
+    return i;
+  }
+  for(i=p->iFirst; i<p->sz && p->a[i]<=0; i++){}
+  assert( i<p->sz );
+  p->iFirst = i;
+  return p->a[i];
+}
+
+/*
+** Remove and return an arbitrary element of the bag.  Return 0 if
+** the bag is empty.  Emptying a bag by repeated calls to this routine
+** takes time proportional to the size of the bag.
+*/
+int bag_pop(Bag *p){
+  int e = bag_first(p);
+  if( e==0 ) return 0;
+  if( p->isDense ){
+    p->aBit[e>>5] &= ~(1u<<(e&31));
+    p->cnt--;
   }else{
-    return 0;
+    bag_remove_slot(p, p->iFirst);
   }
+  return e;
 }
 
 /*
@@ -183,12 +345,16 @@ int bag_first(Bag *p){
 */
 int bag_next(Bag *p, int e){
   unsigned h;
-  assert( p->sz>0 );
+  unsigned mask;
   assert( e>0 );
-  h = bag_hash(e)%p->sz;
+  if( p->isDense ){
+    return bag_dense_next(p, e+1);
+  }
+  assert( p->sz>0 );
+  mask = p->sz - 1;
+  h = bag_hash(e) & mask;
   while( p->a[h] && p->a[h]!=e ){
-    h++;
-    if( h>=p->sz ) h = 0;
+    h = (h+1) & mask;
   }
   assert( p->a[h] );
   h++;
@@ -198,9 +364,93 @@ int bag_next(Bag *p, int e){
   return h<p->sz ? p->a[h] : 0;
 }
 
+/*
+** Step through the elements of the bag without looking each one up
+** again.  Set *piCursor to zero before the first call.  Each call
+** returns one element, or 0 when there are no more.  The bag must not
+** be changed while the iteration is in progress.
+*/
+int bag_step(Bag *p, int *piCursor){
+  int i = *piCursor;
+  if( p->isDense ){
+    i = bag_dense_next(p, i+1);
+    *piCursor = i;
+    return i;
+  }
+  while( i<p->sz && p->a[i]<=0 ) i++;
+  if( i>=p->sz ){
+    *piCursor = p->sz;
+    return 0;
+  }
+  *piCursor = i+1;
+  return p->a[i];
+}
+
 /*
 ** Return the number of elements in the bag.
 */
 int bag_count(Bag *p){
   return p->cnt;
 }
+
+/*
+** COMMAND: test-bag-benchmark
+**
+** Usage: %vcs test-bag-benchmark ?OPTIONS?
+**
+** Time the basic Bag operations on N integers and print the results.
+** No repository is needed.  Options:
+**
+**    --count N       Number of elements.  Default 1000000
+**    --stride N      Distance between consecutive elements.  Default 1
+**    --dense         Use the dense-bitmap representation
+*/
+void test_bag_benchmark_cmd(void){
+  const char *z;
+  int N = 1000000;
+  int stride = 1;
+  int isDense = find_option("dense",0,0)!=0;
+  int i, e, cursor, nFound;
+  sqlite3_uint64 t0;
+  Bag b;
+
+  if( (z = find_option("count",0,1))!=0 ) N = atoi(z);
+  if( (z = find_option("stride",0,1))!=0 ) stride = atoi(z);
+  verify_all_options();
+  if( N<1 || stride<1 ) usage("?OPTIONS?");
+  if( isDense ){
+    bag_init_dense(&b);
+  }else{
+    bag_init(&b);
+  }
+
+  t0 = vcs_timer_now();
+  for(i=1; i<=N; i++) bag_insert(&b, i*stride);
+  vcs_print("insert:  %10.3f ms\n", (vcs_timer_now()-t0)/1000.0);
+
+  t0 = vcs_timer_now();
+  for(i=1, nFound=0; i<=N*2; i++) nFound += bag_find(&b, i*stride);
+  vcs_print("find:    %10.3f ms  (%d hits)\n",
+            (vcs_timer_now()-t0)/1000.0, nFound);
+
+  t0 = vcs_timer_now();
+  for(cursor=0, nFound=0; bag_step(&b, &cursor)>0; nFound++){}
+  vcs_print("step:    %10.3f ms  (%d elements)\n",
+            (vcs_timer_now()-t0)/1000.0, nFound);
+
+  t0 = vcs_timer_now();
+  for(e=bag_first(&b), nFound=0; e; e=bag_next(&b, e)) nFound++;
+  vcs_print("next:    %10.3f ms  (%d elements)\n",
+            (vcs_timer_now()-t0)/1000.0, nFound);
+
+  t0 = vcs_timer_now();
+  for(i=1; i<=N; i+=2) bag_remove(&b, i*stride);
+  vcs_print("remove:  %10.3f ms  (%d left)\n",
+            (vcs_timer_now()-t0)/1000.0, bag_count(&b));
+
+  t0 = vcs_timer_now();
+  for(nFound=0; bag_pop(&b)>0; nFound++){}
+  vcs_print("pop:     %10.3f ms  (%d popped)\n",
+            (vcs_timer_now()-t0)/1000.0, nFound);
+  bag_clear(&b);
+}
@@ -1,18 +1,23 @@
 #include "config.h"
 #include <zlib.h>
+#if !defined(_WIN32)
+# include <sys/mman.h>
+# include <fcntl.h>
+#endif
 #include "blob.h"
 
 #if INTERFACE
 /*
 ** A Blob can hold a string or a binary object of arbitrary size.  The
-** size changes as necessary.
+** size changes as necessary.  Sizes are 64-bit so that a Blob can hold
+** files larger than 4GB.
 */
 struct Blob {
-  unsigned int nUsed;            /* Number of bytes used in aData[] */
-  unsigned int nAlloc;           /* Number of bytes allocated for aData[] */
-  unsigned int iCursor;          /* Next character of input to parse */
+  i64 nUsed;                     /* Number of bytes used in aData[] */
+  i64 nAlloc;                    /* Number of bytes allocated for aData[] */
+  i64 iCursor;                   /* Next character of input to parse */
   char *aData;                   /* Where the information is stored */
-  void (*xRealloc)(Blob*, unsigned int); /* Function to reallocate the buffer */
+  void (*xRealloc)(Blob*, i64);  /* Function to reallocate the buffer */
 };
 
 /*
@@ -32,13 +37,35 @@ struct Blob {
 #define BLOB_SEEK_CUR 2
 #define BLOB_SEEK_END 3
 
+/*
+** The smallest buffer allocated for a growing blob.  Short strings built
+** by many small appends start out with room for this many bytes rather
+** than being reallocated on nearly every append.
+*/
+#define BLOB_MIN_ALLOC  64
+
+/*
+** Files smaller than this are read by blob_map_file() rather than
+** mapped, since reading them costs less than setting up a mapping.
+*/
+#define BLOB_MMAP_MIN  65536
+
 #endif /* INTERFACE */
 
+/*
+** fread(), fwrite() and zlib are handed content larger than this many
+** bytes in pieces.  zlib counts the input and output of each call with
+** a 32-bit integer.
+*/
+#define BLOB_CHUNK  0x40000000
+
 /*
 ** Make sure a blob is initialized
 */
 #define blob_is_init(x) \
-  assert((x)->xRealloc==blobReallocMalloc || (x)->xRealloc==blobReallocStatic)
+  assert((x)->xRealloc==blobReallocMalloc || (x)->xRealloc==blobReallocStatic \
+         || (x)->xRealloc==blobReallocMmap \
+         || (x)->xRealloc==blobReallocArena)
 
 /*
 ** Make sure a blob does not contain malloced memory.
@@ -109,29 +136,57 @@ static void blob_panic(void){
   fossil_exit(1);
 }
 
+/*
+** Counters of the memory allocations made for blob content.  They are
+** reported at exit by the --blobstats option.
+*/
+static struct {
+  i64 nMalloc;        /* Buffers allocated */
+  i64 nRealloc;       /* Buffers resized */
+  i64 nFree;          /* Buffers freed */
+  i64 nByte;          /* Total bytes requested by allocations and resizes */
+} blobStats;
+
+/*
+** Print the blob allocation counters on stderr.
+*/
+void blob_print_stats(void){
+  fprintf(stderr,
+    "blob allocations: %lld  resizes: %lld  frees: %lld  bytes: %lld\n",
+    blobStats.nMalloc, blobStats.nRealloc, blobStats.nFree, blobStats.nByte);
+}
+
 /*
 ** A reallocation function that assumes that aData came from malloc().
-** This function attempts to resize the buffer of the blob to hold
-** newSize bytes.  
+** This function makes sure the buffer of the blob can hold newSize
+** bytes.  A buffer is only ever enlarged here, so that a blob which is
+** resized down and then grown again does not bounce between two sizes.
+** Use blob_shrink_to_fit() to give back unused space.
 **
 ** No attempt is made to recover from an out-of-memory error.
 ** If an OOM error occurs, an error message is printed on stderr
 ** and the program exits.
 */
-void blobReallocMalloc(Blob *pBlob, unsigned int newSize){
+void blobReallocMalloc(Blob *pBlob, i64 newSize){
   if( newSize==0 ){
+    if( pBlob->aData ) blobStats.nFree++;
     free(pBlob->aData);
     pBlob->aData = 0;
     pBlob->nAlloc = 0;
     pBlob->nUsed = 0;
     pBlob->iCursor = 0;
-  }else if( newSize>pBlob->nAlloc || newSize<pBlob->nAlloc-4000 ){
-    char *pNew = fossil_realloc(pBlob->aData, newSize);
+  }else if( newSize>pBlob->nAlloc ){
+    char *pNew;
+    if( newSize!=(i64)(size_t)newSize ) blob_panic();
+    if( pBlob->aData ){
+      blobStats.nRealloc++;
+    }else{
+      blobStats.nMalloc++;
+    }
+    blobStats.nByte += newSize;
+    pNew = fossil_realloc(pBlob->aData, (size_t)newSize);
     pBlob->aData = pNew;
     pBlob->nAlloc = newSize;
-    if( pBlob->nUsed>pBlob->nAlloc ){
-      pBlob->nUsed = pBlob->nAlloc;
-    }
   }
 }
 
@@ -147,11 +202,15 @@ const Blob empty_blob = BLOB_INITIALIZER;
 ** A reallocation function for when the initial string is in unmanaged
 ** space.  Copy the string to memory obtained from malloc().
 */
-static void blobReallocStatic(Blob *pBlob, unsigned int newSize){
+static void blobReallocStatic(Blob *pBlob, i64 newSize){
   if( newSize==0 ){
     *pBlob = empty_blob;
   }else{
-    char *pNew = fossil_malloc( newSize );
+    char *pNew;
+    if( newSize!=(i64)(size_t)newSize ) blob_panic();
+    blobStats.nMalloc++;
+    blobStats.nByte += newSize;
+    pNew = fossil_malloc( (size_t)newSize );
     if( pBlob->nUsed>newSize ) pBlob->nUsed = newSize;
     memcpy(pNew, pBlob->aData, pBlob->nUsed);
     pBlob->aData = pNew;
@@ -160,6 +219,41 @@ static void blobReallocStatic(Blob *pBlob, unsigned int newSize){
   }
 }
 
+/*
+** A reallocation function for a blob that holds a read-only mapping of
+** a file, as set up by blob_map_file().  The mapping is released.  Unless
+** the blob is being reset, its content is first copied to memory
+** obtained from malloc() so that it can be changed.
+*/
+static void blobReallocMmap(Blob *pBlob, i64 newSize){
+#if !defined(_WIN32)
+  char *aMap = pBlob->aData;
+  i64 nMap = pBlob->nAlloc;
+  blobReallocStatic(pBlob, newSize);
+  munmap(aMap, (size_t)nMap);
+#else
+  blobReallocStatic(pBlob, newSize);
+#endif
+}
+
+/*
+** A reallocation function for a blob whose memory comes from the arena
+** of the current command, as set up by blob_zero_arena().  The old
+** buffer is left in the arena, which gets it back when it is rewound.
+*/
+static void blobReallocArena(Blob *pBlob, i64 newSize){
+  if( newSize==0 ){
+    *pBlob = empty_blob;
+  }else if( newSize>pBlob->nAlloc ){
+    char *pNew;
+    if( newSize!=(i64)(size_t)newSize ) blob_panic();
+    pNew = arena_alloc(arena_default(), (size_t)newSize);
+    memcpy(pNew, pBlob->aData, pBlob->nUsed);
+    pBlob->aData = pNew;
+    pBlob->nAlloc = newSize;
+  }
+}
+
 /*
 ** Reset a blob to be an empty container.
 */
@@ -185,7 +279,7 @@ int blob_is_reset(Blob *pBlob){
 ** Initialize a blob to a string or byte-array constant of a specified length.
 ** Any prior data in the blob is discarded.
 */
-void blob_init(Blob *pBlob, const char *zData, int size){
+void blob_init(Blob *pBlob, const char *zData, i64 size){
   assert_blob_is_reset(pBlob);
   if( zData==0 ){
     *pBlob = empty_blob;
@@ -219,18 +313,65 @@ void blob_zero(Blob *pBlob){
   pBlob->xRealloc = blobReallocStatic;
 }
 
+/*
+** Initialize a blob to an empty string whose memory, once it grows,
+** comes from the arena of the current command rather than from malloc().
+** The blob must not be used after the arena is rewound past the point
+** where it was zeroed.
+*/
+void blob_zero_arena(Blob *pBlob){
+  blob_zero(pBlob);
+  pBlob->nAlloc = 0;   /* The empty string is static: never write to it */
+  pBlob->xRealloc = blobReallocArena;
+}
+
+/*
+** Make sure the buffer of a blob has room for at least n bytes of
+** content plus a nul terminator.  The buffer is allocated at exactly
+** that size, so reserve the final size up front when it is known.
+*/
+void blob_reserve(Blob *pBlob, i64 n){
+  blob_is_init(pBlob);
+  if( n>=pBlob->nAlloc ){
+    pBlob->xRealloc(pBlob, n+1);
+    if( n>=pBlob->nAlloc ){
+      blob_panic();
+    }
+  }
+}
+
+/*
+** Release the part of the buffer of a blob beyond its content and the
+** nul terminator.  This only applies to buffers obtained from malloc().
+*/
+void blob_shrink_to_fit(Blob *pBlob){
+  blob_is_init(pBlob);
+  if( pBlob->xRealloc!=blobReallocMalloc || pBlob->aData==0 ) return;
+  if( pBlob->nAlloc>pBlob->nUsed+1 ){
+    blobStats.nRealloc++;
+    blobStats.nByte += pBlob->nUsed+1;
+    pBlob->aData = fossil_realloc(pBlob->aData, (size_t)(pBlob->nUsed+1));
+    pBlob->nAlloc = pBlob->nUsed+1;
+    pBlob->aData[pBlob->nUsed] = 0;
+  }
+}
+
 /*
 ** Append text or data to the end of a blob.
+**
+** When the buffer is full its size is doubled, or grown to fit nData
+** if that is more, so a long run of appends costs only a logarithmic
+** number of reallocations.
 */
-void blob_append(Blob *pBlob, const char *aData, int nData){
+void blob_append(Blob *pBlob, const char *aData, i64 nData){
   blob_is_init(pBlob);
   if( nData<0 ) nData = strlen(aData);
   if( nData==0 ) return;
   if( pBlob->nUsed + nData >= pBlob->nAlloc ){
-    pBlob->xRealloc(pBlob, pBlob->nUsed + nData + pBlob->nAlloc + 100);
-    if( pBlob->nUsed + nData >= pBlob->nAlloc ){
-      blob_panic();
-    }
+    i64 nNew = pBlob->nAlloc*2;
+    if( nNew<pBlob->nUsed + nData + 1 ) nNew = pBlob->nUsed + nData + 1;
+    if( nNew<BLOB_MIN_ALLOC ) nNew = BLOB_MIN_ALLOC;
+    blob_reserve(pBlob, nNew-1);
   }
   memcpy(&pBlob->aData[pBlob->nUsed], aData, nData);
   pBlob->nUsed += nData;
@@ -255,7 +396,7 @@ char *blob_str(Blob *p){
     blob_append(p, "", 1);
     p->nUsed = 0;
   }
-  if( p->aData[p->nUsed]!=0 ){
+  if( p->xRealloc==blobReallocMmap || p->aData[p->nUsed]!=0 ){
     blob_materialize(p);
   }
   return p->aData;
@@ -267,6 +408,7 @@ char *blob_str(Blob *p){
 char *blob_terminate(Blob *p){
   blob_is_init(p);
   if( p->nUsed==0 ) return "";
+  if( p->xRealloc==blobReallocMmap ) return blob_materialize(p);
   p->aData[p->nUsed] = 0;
   return p->aData;
 }
@@ -276,7 +418,8 @@ char *blob_terminate(Blob *p){
 ** blob is less then, equal to, or greater than the second.
 */
 int blob_compare(Blob *pA, Blob *pB){
-  int szA, szB, sz, rc;
+  i64 szA, szB, sz;
+  int rc;
   blob_is_init(pA);
   blob_is_init(pB);
   szA = blob_size(pA);
@@ -284,7 +427,7 @@ int blob_compare(Blob *pA, Blob *pB){
   sz = szA<szB ? szA : szB;
   rc = memcmp(blob_buffer(pA), blob_buffer(pB), sz);
   if( rc==0 ){
-    rc = szA - szB;
+    rc = szA<szB ? -1 : szA>szB;
   }
   return rc;
 }
@@ -295,7 +438,7 @@ int blob_compare(Blob *pA, Blob *pB){
 ** If lengths are different, immediately returns 1.
 */
 int blob_constant_time_cmp(Blob *pA, Blob *pB){
-  int szA, szB, i;
+  i64 szA, szB, i;
   unsigned char *buf1, *buf2;
   unsigned char rc = 0;
 
@@ -343,7 +486,7 @@ int blob_eq_str(Blob *pBlob, const char *z, int n){
 ** Attempt to resize a blob so that its internal buffer is 
 ** nByte in size.  The blob is truncated if necessary.
 */
-void blob_resize(Blob *pBlob, unsigned int newSize){
+void blob_resize(Blob *pBlob, i64 newSize){
   pBlob->xRealloc(pBlob, newSize+1);
   pBlob->nUsed = newSize;
   pBlob->aData[newSize] = 0;
@@ -374,7 +517,7 @@ void blob_dehttpize(Blob *pBlob){
 **
 ** After this call completes, pTo will be an ephemeral blob.
 */
-int blob_extract(Blob *pFrom, int N, Blob *pTo){
+i64 blob_extract(Blob *pFrom, i64 N, Blob *pTo){
   blob_is_init(pFrom);
   assert_blob_is_reset(pTo);
   if( pFrom->iCursor + N > pFrom->nUsed ){
@@ -403,7 +546,7 @@ void blob_rewind(Blob *p){
 /*
 ** Seek the cursor in a blob to the indicated offset.
 */
-int blob_seek(Blob *p, int offset, int whence){
+i64 blob_seek(Blob *p, i64 offset, int whence){
   if( whence==BLOB_SEEK_SET ){
     p->iCursor = offset;
   }else if( whence==BLOB_SEEK_CUR ){
@@ -423,7 +566,7 @@ int blob_seek(Blob *p, int offset, int whence){
 /*
 ** Return the current offset into the blob
 */
-int blob_tell(Blob *p){
+i64 blob_tell(Blob *p){
   return p->iCursor;
 }
 
@@ -539,8 +682,8 @@ int blob_sqltoken(Blob *pFrom, Blob *pTo){
 ** into a new blob.  The new blob is an ephemerial reference to the
 ** original blob.  The cursor of the original blob is unchanged.
 */
-int blob_tail(Blob *pFrom, Blob *pTo){
-  int iCursor = pFrom->iCursor;
+i64 blob_tail(Blob *pFrom, Blob *pTo){
+  i64 iCursor = pFrom->iCursor;
   blob_extract(pFrom, pFrom->nUsed-pFrom->iCursor, pTo);
   pFrom->iCursor = iCursor;
   return pTo->nUsed;
@@ -643,12 +786,27 @@ void blob_vappendf(Blob *pBlob, const char *zFormat, va_list ap){
   vxprintf(pBlob, zFormat, ap);
 }
 
+/*
+** Read up to N bytes from channel in into z[], BLOB_CHUNK bytes at a
+** time.  Return the number of bytes read.
+*/
+static i64 blob_fread(char *z, i64 N, FILE *in){
+  i64 got = 0;
+  while( got<N ){
+    size_t n = N-got>BLOB_CHUNK ? BLOB_CHUNK : (size_t)(N-got);
+    size_t m = fread(&z[got], 1, n, in);
+    got += m;
+    if( m<n ) break;
+  }
+  return got;
+}
+
 /*
 ** Initalize a blob to the data on an input channel.  Return 
 ** the number of bytes read into the blob.  Any prior content
 ** of the blob is discarded, not freed.
 */
-int blob_read_from_channel(Blob *pBlob, FILE *in, int nToRead){
+i64 blob_read_from_channel(Blob *pBlob, FILE *in, i64 nToRead){
   size_t n;
   blob_zero(pBlob);
   if( nToRead<0 ){
@@ -659,10 +817,10 @@ int blob_read_from_channel(Blob *pBlob, FILE *in, int nToRead){
         blob_append(pBlob, zBuf, n);
       }
     }
+    blob_shrink_to_fit(pBlob);
   }else{
     blob_resize(pBlob, nToRead);
-    n = fread(blob_buffer(pBlob), 1, nToRead, in);
-    blob_resize(pBlob, n);
+    blob_resize(pBlob, blob_fread(blob_buffer(pBlob), nToRead, in));
   }
   return blob_size(pBlob);
 }
@@ -675,8 +833,8 @@ int blob_read_from_channel(Blob *pBlob, FILE *in, int nToRead){
 **
 ** Return the number of bytes read.  Return -1 for an error.
 */
-int blob_read_from_file(Blob *pBlob, const char *zFilename){
-  int size, got;
+i64 blob_read_from_file(Blob *pBlob, const char *zFilename){
+  i64 size, got;
   FILE *in;
   if( zFilename==0 || zFilename[0]==0
         || (zFilename[0]=='-' && zFilename[1]==0) ){
@@ -695,7 +853,7 @@ int blob_read_from_file(Blob *pBlob, const char *zFilename){
   if( in==0 ){
     fossil_panic("cannot open %s for reading", zFilename);
   }
-  got = fread(blob_buffer(pBlob), 1, size, in);
+  got = blob_fread(blob_buffer(pBlob), size, in);
   fclose(in);
   if( got<size ){
     blob_resize(pBlob, got);
@@ -703,6 +861,52 @@ int blob_read_from_file(Blob *pBlob, const char *zFilename){
   return got;
 }
 
+/*
+** Initialize a blob to be the content of a file, like
+** blob_read_from_file(), but map the file into memory read-only rather
+** than reading it, when it is large enough for that to pay off.  This
+** spares a copy of the content for callers that only look at it, such
+** as hashing, comparing or compressing.
+**
+** The content must not be changed in place.  Any routine that resizes
+** the blob, blob_str() or blob_materialize() for instance, first copies
+** the content to malloced memory and releases the mapping.  The file
+** must not be rewritten while the blob refers to it.
+**
+** Return the number of bytes in the blob.  Return -1 for an error.
+*/
+i64 blob_map_file(Blob *pBlob, const char *zFilename){
+#if !defined(_WIN32)
+  i64 size;
+  int fd;
+  void *aMap;
+  if( zFilename==0 || zFilename[0]==0
+        || (zFilename[0]=='-' && zFilename[1]==0) ){
+    return blob_read_from_file(pBlob, zFilename);
+  }
+  size = file_wd_size(zFilename);
+  if( size<BLOB_MMAP_MIN || size!=(i64)(size_t)size ){
+    return blob_read_from_file(pBlob, zFilename);
+  }
+  fd = open(zFilename, O_RDONLY);
+  if( fd<0 ){
+    return blob_read_from_file(pBlob, zFilename);
+  }
+  aMap = mmap(0, (size_t)size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if( aMap==MAP_FAILED ){
+    return blob_read_from_file(pBlob, zFilename);
+  }
+  pBlob->nUsed = pBlob->nAlloc = size;
+  pBlob->aData = (char*)aMap;
+  pBlob->iCursor = 0;
+  pBlob->xRealloc = blobReallocMmap;
+  return size;
+#else
+  return blob_read_from_file(pBlob, zFilename);
+#endif
+}
+
 /*
 ** Reads symlink destination path and puts int into blob.
 ** Any prior content of the blob is discarded, not freed.
@@ -729,6 +933,21 @@ int blob_read_link(Blob *pBlob, const char *zFilename){
 }
 
 
+/*
+** Write the N bytes of z[] to channel out, BLOB_CHUNK bytes at a time.
+** Return the number of bytes written.
+*/
+static i64 blob_fwrite(const char *z, i64 N, FILE *out){
+  i64 wrote = 0;
+  while( wrote<N ){
+    size_t n = N-wrote>BLOB_CHUNK ? BLOB_CHUNK : (size_t)(N-wrote);
+    size_t m = fwrite(&z[wrote], 1, n, out);
+    wrote += m;
+    if( m<n ) break;
+  }
+  return wrote;
+}
+
 /*
 ** Write the content of a blob into a file.
 **
@@ -736,12 +955,12 @@ int blob_read_link(Blob *pBlob, const char *zFilename){
 **
 ** Return the number of bytes written.
 */
-int blob_write_to_file(Blob *pBlob, const char *zFilename){
+i64 blob_write_to_file(Blob *pBlob, const char *zFilename){
   FILE *out;
-  int wrote;
+  i64 wrote;
 
   if( zFilename[0]==0 || (zFilename[0]=='-' && zFilename[1]==0) ){
-    int n;
+    i64 n;
 #if defined(_WIN32)
     if( _isatty(fileno(stdout)) ){
       char *z;
@@ -752,9 +971,7 @@ int blob_write_to_file(Blob *pBlob, const char *zFilename){
       return n;
     }
 #endif
-    n = blob_size(pBlob);
-    fwrite(blob_buffer(pBlob), 1, n, stdout);
-    return n;
+    return blob_fwrite(blob_buffer(pBlob), blob_size(pBlob), stdout);
   }else{
     int i, nName;
     char *zName, zBuf[1000];
@@ -796,15 +1013,106 @@ int blob_write_to_file(Blob *pBlob, const char *zFilename){
     if( zName!=zBuf ) free(zName);
   }
   blob_is_init(pBlob);
-  wrote = fwrite(blob_buffer(pBlob), 1, blob_size(pBlob), out);
+  wrote = blob_fwrite(blob_buffer(pBlob), blob_size(pBlob), out);
   fclose(out);
   if( wrote!=blob_size(pBlob) && out!=stdout ){
-    fossil_fatal_recursive("short write: %d of %d bytes to %s", wrote,
+    fossil_fatal_recursive("short write: %lld of %lld bytes to %s", wrote,
        blob_size(pBlob), zFilename);
   }
   return wrote;
 }
 
+/*
+** Compressed content begins with the size of the uncompressed content
+** as a 4-byte big-endian integer.  Content of 4GB or more does not fit,
+** so its size is written as BLOB_SIZE_EXT followed by the real size as
+** an 8-byte big-endian integer.  Older repositories can never hold a
+** 4-byte size of BLOB_SIZE_EXT, as such content could not be stored.
+*/
+#define BLOB_SIZE_EXT  0xffffffff
+
+/*
+** Write the size header for n bytes of uncompressed content into z[],
+** which must have room for 12 bytes.  Return the length of the header.
+*/
+static int blob_put_size_header(unsigned char *z, i64 n){
+  int i, nHdr = 4;
+  if( n>=BLOB_SIZE_EXT ){
+    z[0] = z[1] = z[2] = z[3] = 0xff;
+    z += 4;
+    nHdr = 12;
+    for(i=7; i>=4; i--){
+      z[i] = n & 0xff;
+      n >>= 8;
+    }
+  }
+  z[0] = n>>24 & 0xff;
+  z[1] = n>>16 & 0xff;
+  z[2] = n>>8 & 0xff;
+  z[3] = n & 0xff;
+  return nHdr;
+}
+
+/*
+** Read the size header at the start of the nIn bytes of compressed
+** content in z[] and store the size in *pN.  Return the length of the
+** header, or 0 if the content is too short to hold one.
+*/
+static int blob_get_size_header(const unsigned char *z, i64 nIn, i64 *pN){
+  i64 n;
+  int i;
+  if( nIn<4 ) return 0;
+  n = ((i64)z[0]<<24) + (z[1]<<16) + (z[2]<<8) + z[3];
+  if( n!=BLOB_SIZE_EXT ){
+    *pN = n;
+    return 4;
+  }
+  if( nIn<12 ) return 0;
+  for(i=4, n=0; i<12; i++){
+    n = (n<<8) + z[i];
+  }
+  *pN = n;
+  return 12;
+}
+
+/*
+** Run the content of pIn through the deflate stream and append the
+** compressed output to pOut, which is enlarged as needed.  If isLast
+** is true the stream is finished as well.
+**
+** Content larger than BLOB_CHUNK is fed to zlib one chunk at a time,
+** since a single deflate() call can only take 4GB of input or output.
+*/
+static void blob_deflate(z_stream *pStream, Blob *pIn, int isLast, Blob *pOut){
+  unsigned char *zIn = (unsigned char*)blob_buffer(pIn);
+  i64 nIn = blob_size(pIn);
+  int rc;
+  do{
+    uInt nChunk = nIn>BLOB_CHUNK ? BLOB_CHUNK : (uInt)nIn;
+    int flush = (isLast && nChunk==nIn) ? Z_FINISH : Z_NO_FLUSH;
+    pStream->next_in = zIn;
+    pStream->avail_in = nChunk;
+    do{
+      i64 nRoom = pOut->nAlloc - pOut->nUsed - 1;
+      if( nRoom<=0 ){
+        pOut->xRealloc(pOut, pOut->nAlloc + pOut->nAlloc/2 + 1000);
+        nRoom = pOut->nAlloc - pOut->nUsed - 1;
+      }
+      if( nRoom>BLOB_CHUNK ) nRoom = BLOB_CHUNK;
+      pStream->next_out = (unsigned char*)&pOut->aData[pOut->nUsed];
+      pStream->avail_out = (uInt)nRoom;
+      rc = deflate(pStream, flush);
+      if( rc==Z_STREAM_ERROR ){
+        fossil_panic("zlib deflate failed");
+      }
+      pOut->nUsed += nRoom - pStream->avail_out;
+    }while( pStream->avail_in>0 || pStream->avail_out==0
+            || (flush==Z_FINISH && rc!=Z_STREAM_END) );
+    zIn += nChunk;
+    nIn -= nChunk;
+  }while( nIn>0 );
+}
+
 /*
 ** Compress a blob pIn.  Store the result in pOut.  It is ok for pIn and
 ** pOut to be the same blob. 
@@ -812,25 +1120,24 @@ int blob_write_to_file(Blob *pBlob, const char *zFilename){
 ** pOut must either be the same as pIn or else uninitialized.
 */
 void blob_compress(Blob *pIn, Blob *pOut){
-  unsigned int nIn = blob_size(pIn);
-  unsigned int nOut = 13 + nIn + (nIn+999)/1000;
-  unsigned long int nOut2;
-  unsigned char *outBuf;
+  i64 nIn = blob_size(pIn);
+  i64 nOut = 13 + nIn + (nIn+999)/1000;
+  z_stream stream;
   Blob temp;
   blob_zero(&temp);
-  blob_resize(&temp, nOut+4);
-  outBuf = (unsigned char*)blob_buffer(&temp);
-  outBuf[0] = nIn>>24 & 0xff;
-  outBuf[1] = nIn>>16 & 0xff;
-  outBuf[2] = nIn>>8 & 0xff;
-  outBuf[3] = nIn & 0xff;
-  nOut2 = (long int)nOut;
-  compress(&outBuf[4], &nOut2,
-           (unsigned char*)blob_buffer(pIn), blob_size(pIn));
+  blob_resize(&temp, nOut+12);
+  temp.nUsed = blob_put_size_header((unsigned char*)blob_buffer(&temp), nIn);
+  stream.zalloc = (alloc_func)0;
+  stream.zfree = (free_func)0;
+  stream.opaque = 0;
+  deflateInit(&stream, Z_DEFAULT_COMPRESSION);
+  blob_deflate(&stream, pIn, 1, &temp);
+  deflateEnd(&stream);
+  blob_resize(&temp, temp.nUsed);
+  blob_shrink_to_fit(&temp);
   if( pOut==pIn ) blob_reset(pOut);
   assert_blob_is_reset(pOut);
   *pOut = temp;
-  blob_resize(pOut, nOut2+4);
 }
 
 /*
@@ -852,33 +1159,22 @@ void compress_cmd(void){
 ** pIn2.
 */
 void blob_compress2(Blob *pIn1, Blob *pIn2, Blob *pOut){
-  unsigned int nIn = blob_size(pIn1) + blob_size(pIn2);
-  unsigned int nOut = 13 + nIn + (nIn+999)/1000;
-  unsigned char *outBuf;
+  i64 nIn = blob_size(pIn1) + blob_size(pIn2);
+  i64 nOut = 13 + nIn + (nIn+999)/1000;
   z_stream stream;
   Blob temp;
   blob_zero(&temp);
-  blob_resize(&temp, nOut+4);
-  outBuf = (unsigned char*)blob_buffer(&temp);
-  outBuf[0] = nIn>>24 & 0xff;
-  outBuf[1] = nIn>>16 & 0xff;
-  outBuf[2] = nIn>>8 & 0xff;
-  outBuf[3] = nIn & 0xff;
+  blob_resize(&temp, nOut+12);
+  temp.nUsed = blob_put_size_header((unsigned char*)blob_buffer(&temp), nIn);
   stream.zalloc = (alloc_func)0;
   stream.zfree = (free_func)0;
   stream.opaque = 0;
-  stream.avail_out = nOut;
-  stream.next_out = &outBuf[4];
   deflateInit(&stream, 9);
-  stream.avail_in = blob_size(pIn1);
-  stream.next_in = (unsigned char*)blob_buffer(pIn1);
-  deflate(&stream, 0);
-  stream.avail_in = blob_size(pIn2);
-  stream.next_in = (unsigned char*)blob_buffer(pIn2);
-  deflate(&stream, 0);
-  deflate(&stream, Z_FINISH);
-  blob_resize(&temp, stream.total_out + 4);
+  blob_deflate(&stream, pIn1, 0, &temp);
+  blob_deflate(&stream, pIn2, 1, &temp);
   deflateEnd(&stream);
+  blob_resize(&temp, temp.nUsed);
+  blob_shrink_to_fit(&temp);
   if( pOut==pIn1 ) blob_reset(pOut);
   if( pOut==pIn2 ) blob_reset(pOut);
   assert_blob_is_reset(pOut);
@@ -902,29 +1198,61 @@ void compress2_cmd(void){
 ** pOut to be the same blob.
 **
 ** pOut must be either uninitialized or the same as pIn.
+**
+** Both the 4-byte size header of older repositories and the extended
+** header of content larger than 4GB are understood.  Like compression,
+** the content is passed through zlib in chunks of BLOB_CHUNK bytes.
 */
 int blob_uncompress(Blob *pIn, Blob *pOut){
-  unsigned int nOut;
+  i64 nOut, nDone, nLeft;
   unsigned char *inBuf;
-  unsigned int nIn = blob_size(pIn);
+  i64 nIn = blob_size(pIn);
+  int nHdr;
   Blob temp;
   int rc;
-  unsigned long int nOut2;
+  z_stream stream;
   if( nIn<=4 ){
     return 0;
   }
   inBuf = (unsigned char*)blob_buffer(pIn);
-  nOut = (inBuf[0]<<24) + (inBuf[1]<<16) + (inBuf[2]<<8) + inBuf[3];
+  nHdr = blob_get_size_header(inBuf, nIn, &nOut);
+  if( nHdr==0 ){
+    return 1;
+  }
   blob_zero(&temp);
   blob_resize(&temp, nOut+1);
-  nOut2 = (long int)nOut;
-  rc = uncompress((unsigned char*)blob_buffer(&temp), &nOut2, 
-                  &inBuf[4], nIn - 4);
-  if( rc!=Z_OK ){
-    blob_reset(&temp);
-    return 1;
+  stream.zalloc = (alloc_func)0;
+  stream.zfree = (free_func)0;
+  stream.opaque = 0;
+  stream.next_in = &inBuf[nHdr];
+  stream.avail_in = 0;
+  inflateInit(&stream);
+  nLeft = nIn - nHdr;
+  nDone = 0;
+  while( 1 ){
+    i64 nRoom = nOut + 1 - nDone;
+    if( stream.avail_in==0 && nLeft>0 ){
+      stream.avail_in = nLeft>BLOB_CHUNK ? BLOB_CHUNK : (uInt)nLeft;
+      nLeft -= stream.avail_in;
+    }
+    if( nRoom>BLOB_CHUNK ) nRoom = BLOB_CHUNK;
+    stream.next_out = (unsigned char*)&temp.aData[nDone];
+    stream.avail_out = (uInt)nRoom;
+    rc = inflate(&stream, Z_NO_FLUSH);
+    nDone += nRoom - stream.avail_out;
+    if( rc==Z_STREAM_END ) break;
+    if( (rc!=Z_OK && rc!=Z_BUF_ERROR)
+     || (stream.avail_in==0 && nLeft==0 && stream.avail_out>0)
+     || nDone>nOut
+    ){
+      inflateEnd(&stream);
+      blob_reset(&temp);
+      return 1;
+    }
   }
-  blob_resize(&temp, nOut2);
+  inflateEnd(&stream);
+  blob_resize(&temp, nDone);
+  blob_shrink_to_fit(&temp);
   if( pOut==pIn ) blob_reset(pOut);
   assert_blob_is_reset(pOut);
   *pOut = temp;
@@ -971,8 +1299,8 @@ void test_cycle_compress(void){
 */
 void blob_add_cr(Blob *p){
   char *z = p->aData;
-  int j   = p->nUsed;
-  int i, n;
+  i64 j   = p->nUsed;
+  i64 i, n;
   for(i=n=0; i<j; i++){
     if( z[i]=='\n' ) n++;
   }
@@ -995,7 +1323,7 @@ void blob_add_cr(Blob *p){
 ** Remove every \r character from the given blob.
 */
 void blob_remove_cr(Blob *p){
-  int i, j;
+  i64 i, j;
   char *z;
   blob_materialize(p);
   z = p->aData;
@@ -160,22 +160,13 @@ void status_cmd(void){
 }
 
 /*
-** COMMAND: ls
-**
-** Usage: %vcs ls ?OPTIONS?
+** Print the names of all files in the current checkout, one per line.
+** Unless isBrief is true, each name is preceded by its status.
 **
-** Show the names of all files in the current checkout.  The -l provides
-** extra information about each file.
+** We assume that vfile_check_signature has been run.
 */
-void ls_cmd(void){
-  int vid;
+static void ls_print(int isBrief){
   Stmt q;
-  int isBrief;
-
-  isBrief = find_option("l","l", 0)==0;
-  db_must_be_within_tree();
-  vid = db_lget_int("checkout", 0);
-  vfile_check_signature(vid, 0, 0);
   db_prepare(&q,
      "SELECT pathname, deleted, rid, chnged, coalesce(origname!=pathname,0)"
      "  FROM vfile"
@@ -212,6 +203,123 @@ void ls_cmd(void){
   db_finalize(&q);
 }
 
+/*
+** COMMAND: ls
+**
+** Usage: %vcs ls ?OPTIONS?
+**
+** Show the names of all files in the current checkout.  The -l provides
+** extra information about each file.
+*/
+void ls_cmd(void){
+  int vid;
+  int isBrief;
+
+  isBrief = find_option("l","l", 0)==0;
+  db_must_be_within_tree();
+  vid = db_lget_int("checkout", 0);
+  vfile_check_signature(vid, 0, 0);
+  ls_print(isBrief);
+}
+
+/*
+** COMMAND: describe
+**
+** Usage: %vcs describe ?SETTING ...?
+**
+** Report everything a front end needs to show the current checkout,
+** in a single run:
+**
+**    == info          project name, repository, local root and checkout
+**    == settings      the value of each SETTING named on the command
+**                     line, as "NAME (local|global) VALUE"
+**    == remote-url    the URL of the last sync without its password,
+**                     or "off"
+**    == stash         the stashes, in the format of "stash ls"
+**    == ls            the files of the checkout, in the format of "ls -l"
+**
+** Each part starts with a line holding "==" and its name.
+*/
+void describe_cmd(void){
+  int vid;
+  int i;
+  Stmt q;
+  const char *zDb;
+  char *zUrl;
+
+  db_must_be_within_tree();
+  db_open_config(1);
+  vid = db_lget_int("checkout", 0);
+
+  vcs_print("== info\n");
+       /* 012345678901234 */
+  vcs_print("project-name: %s\n", db_get("project-name", "<unnamed>"));
+  vcs_print("repository:   %s\n", db_repository_filename());
+  vcs_print("local-root:   %s\n", g.zLocalRoot);
+  if( vid ){
+    show_common_info(vid, "checkout:", 1, 1);
+  }
+
+  vcs_print("== settings\n");
+  for(i=2; i<g.argc; i++){
+    db_prepare(&q,
+       "SELECT '(local)', value FROM config WHERE name=%Q"
+       " UNION ALL "
+       "SELECT '(global)', value FROM global_config WHERE name=%Q",
+       g.argv[i], g.argv[i]
+    );
+    if( db_step(&q)==SQLITE_ROW ){
+      vcs_print("%-20s %-8s %s\n", g.argv[i], db_column_text(&q, 0),
+                   db_column_text(&q, 1));
+    }else{
+      vcs_print("%-20s\n", g.argv[i]);
+    }
+    db_finalize(&q);
+  }
+
+  /* As "remote-url" does, print the parsed URL so that a password in
+  ** the setting is not shown.  A local repository that has gone away
+  ** cannot be parsed, but its name holds no password either. */
+  vcs_print("== remote-url\n");
+  zUrl = db_get("last-sync-url", 0);
+  if( zUrl==0 ){
+    vcs_print("off\n");
+  }else if( strstr(zUrl, "://")==0 && strncmp(zUrl, "file:", 5)!=0
+         && !file_isfile(zUrl) && file_isdir(zUrl)!=1 ){
+    vcs_print("%s\n", zUrl);
+  }else{
+    url_parse(zUrl);
+    vcs_print("%s\n", g.urlCanonical);
+  }
+
+  vcs_print("== stash\n");
+  zDb = db_name("localdb");
+  if( db_exists("SELECT 1 FROM %s.sqlite_master WHERE name='stash'", zDb) ){
+    db_prepare(&q,
+       "SELECT stashid, (SELECT uuid FROM blob WHERE rid=vid),"
+       "       comment, datetime(ctime) FROM stash"
+       " ORDER BY ctime DESC"
+    );
+    while( db_step(&q)==SQLITE_ROW ){
+      const char *zCom = db_column_text(&q, 2);
+      vcs_print("%5d: [%.14s] on %s\n",
+         db_column_int(&q, 0),
+         db_column_text(&q, 1),
+         db_column_text(&q, 3)
+      );
+      if( zCom && zCom[0] ){
+        vcs_print("       ");
+        comment_print(zCom, 7, 79);
+      }
+    }
+    db_finalize(&q);
+  }
+
+  vcs_print("== ls\n");
+  vfile_check_signature(vid, 0, 0);
+  ls_print(0);
+}
+
 /*
 ** Prepare a commit comment.  Let the user modify it using the
 ** editor specified in the global_config table or either
@@ -37,9 +37,8 @@ void fix_private_blob_dependencies(int showWarning){
     bag_insert(&toUndelta, rid);
   }
   db_finalize(&q);
-  while( (rid = bag_first(&toUndelta))>0 ){
+  while( (rid = bag_pop(&toUndelta))>0 ){
     content_undelta(rid);
-    bag_remove(&toUndelta, rid);
   }
   bag_clear(&toUndelta);
 }
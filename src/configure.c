@@ -110,7 +110,7 @@ int configure_send_group(
         db_column_text(&q, 1),
         db_column_text(&q, 2)
       );
-      blob_appendf(pOut, "config /shun %d\n%s\n",
+      blob_appendf(pOut, "config /shun %lld\n%s\n",
                    blob_size(&rec), blob_str(&rec));
       nCard++;
       blob_reset(&rec);
@@ -130,7 +130,7 @@ int configure_send_group(
         db_column_text(&q, 4),
         db_column_text(&q, 5)
       );
-      blob_appendf(pOut, "config /user %d\n%s\n",
+      blob_appendf(pOut, "config /user %lld\n%s\n",
                    blob_size(&rec), blob_str(&rec));
       nCard++;
       blob_reset(&rec);
@@ -149,7 +149,7 @@ int configure_send_group(
         db_column_text(&q, 3),
         db_column_text(&q, 4)
       );
-      blob_appendf(pOut, "config /reportfmt %d\n%s\n",
+      blob_appendf(pOut, "config /reportfmt %lld\n%s\n",
                    blob_size(&rec), blob_str(&rec));
       nCard++;
       blob_reset(&rec);
@@ -165,7 +165,7 @@ int configure_send_group(
         db_column_text(&q, 1),
         db_column_text(&q, 2)
       );
-      blob_appendf(pOut, "config /concealed %d\n%s\n",
+      blob_appendf(pOut, "config /concealed %lld\n%s\n",
                    blob_size(&rec), blob_str(&rec));
       nCard++;
       blob_reset(&rec);
@@ -183,7 +183,7 @@ int configure_send_group(
           db_column_text(&q, 1),
           db_column_text(&q, 2)
         );
-        blob_appendf(pOut, "config /config %d\n%s\n",
+        blob_appendf(pOut, "config /config %lld\n%s\n",
                      blob_size(&rec), blob_str(&rec));
         nCard++;
         blob_reset(&rec);
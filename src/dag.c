@@ -0,0 +1,258 @@
+/*
+** This file contains code used to keep an in-memory copy of the
+** check-in DAG.
+**
+** The PLINK table is loaded once into compressed adjacency arrays
+** (one array of children and one of parents, each indexed by a
+** per-rid offset table) together with the branch of every check-in.
+** Leaf, ancestor and descendant computations then walk the arrays
+** rather than running one SQL query per node.
+*/
+#include "config.h"
+#include "dag.h"
+#include <assert.h>
+
+#if INTERFACE
+/*
+** The in-memory DAG.  The children of check-in R are
+** aChild[aChildIdx[R]] through aChild[aChildIdx[R+1]-1], and likewise
+** for parents.  aChildPrim[] and aParentPrim[] hold the plink.isprim
+** flag for each link.  Branch ids are arbitrary small integers that
+** compare equal for check-ins on the same branch.  Id 0 is trunk.
+*/
+struct DagIndex {
+  int mxRid;            /* Largest rid in the index */
+  int nLink;            /* Number of PLINK rows loaded */
+  int *aChildIdx;       /* mxRid+2 offsets into aChild[] */
+  int *aChild;          /* Children, grouped by parent */
+  u8 *aChildPrim;       /* True if the link to aChild[i] is primary */
+  int *aParentIdx;      /* mxRid+2 offsets into aParent[] */
+  int *aParent;         /* Parents, grouped by child */
+  u8 *aParentPrim;      /* True if the link to aParent[i] is primary */
+  int *aBranch;         /* Branch id of each check-in */
+  u8 *aBranchStart;     /* True if the check-in starts a new branch */
+  double *aMtime;       /* plink.mtime of each check-in.  0.0 if none */
+};
+#endif
+
+/*
+** The one DAG index for this process.  dagIsLoaded is false until the
+** first call to dag_index() and after dag_index_reset().
+*/
+static DagIndex dagIdx;
+static int dagIsLoaded = 0;
+
+/*
+** Discard the in-memory DAG.  It is reloaded the next time it is
+** needed.  Every writer of PLINK or of branch tags in TAGXREF must call
+** this, since the index does not check the tables for changes.
+*/
+void dag_index_reset(void){
+  if( !dagIsLoaded ) return;
+  free(dagIdx.aChildIdx);
+  free(dagIdx.aChild);
+  free(dagIdx.aChildPrim);
+  free(dagIdx.aParentIdx);
+  free(dagIdx.aParent);
+  free(dagIdx.aParentPrim);
+  free(dagIdx.aBranch);
+  free(dagIdx.aBranchStart);
+  free(dagIdx.aMtime);
+  memset(&dagIdx, 0, sizeof(dagIdx));
+  dagIsLoaded = 0;
+}
+
+/*
+** Load the DAG from the PLINK and TAGXREF tables of the repository.
+*/
+static void dag_index_load(DagIndex *p){
+  Stmt q;
+  int nAlloc = 0;
+  int *aPid = 0;
+  int *aCid = 0;
+  u8 *aPrim = 0;
+  double *aTime = 0;
+  int i, n;
+  int iBranch;
+  const char *zPrev = 0;
+  char *zPrevCopy = 0;
+
+  memset(p, 0, sizeof(*p));
+
+  /* Read all links into flat arrays, noting the largest rid */
+  db_prepare(&q, "SELECT pid, cid, isprim, mtime FROM plink WHERE pid>0");
+  n = 0;
+  while( db_step(&q)==SQLITE_ROW ){
+    if( n>=nAlloc ){
+      nAlloc = nAlloc*2 + 1000;
+      aPid = vcs_realloc(aPid, sizeof(aPid[0])*nAlloc);
+      aCid = vcs_realloc(aCid, sizeof(aCid[0])*nAlloc);
+      aPrim = vcs_realloc(aPrim, sizeof(aPrim[0])*nAlloc);
+      aTime = vcs_realloc(aTime, sizeof(aTime[0])*nAlloc);
+    }
+    aPid[n] = db_column_int(&q, 0);
+    aCid[n] = db_column_int(&q, 1);
+    aPrim[n] = db_column_int(&q, 2)!=0;
+    aTime[n] = db_column_double(&q, 3);
+    if( aPid[n]>p->mxRid ) p->mxRid = aPid[n];
+    if( aCid[n]>p->mxRid ) p->mxRid = aCid[n];
+    n++;
+  }
+  db_finalize(&q);
+  p->nLink = n;
+
+  /* Counting sort the links by parent and by child */
+  p->aChildIdx = vcs_malloc( sizeof(int)*(p->mxRid+2) );
+  p->aParentIdx = vcs_malloc( sizeof(int)*(p->mxRid+2) );
+  memset(p->aChildIdx, 0, sizeof(int)*(p->mxRid+2));
+  memset(p->aParentIdx, 0, sizeof(int)*(p->mxRid+2));
+  for(i=0; i<n; i++){
+    p->aChildIdx[aPid[i]+1]++;
+    p->aParentIdx[aCid[i]+1]++;
+  }
+  for(i=1; i<=p->mxRid+1; i++){
+    p->aChildIdx[i] += p->aChildIdx[i-1];
+    p->aParentIdx[i] += p->aParentIdx[i-1];
+  }
+  p->aChild = vcs_malloc( sizeof(int)*n );
+  p->aChildPrim = vcs_malloc( n );
+  p->aParent = vcs_malloc( sizeof(int)*n );
+  p->aParentPrim = vcs_malloc( n );
+  p->aMtime = vcs_malloc( sizeof(double)*(p->mxRid+1) );
+  memset(p->aMtime, 0, sizeof(double)*(p->mxRid+1));
+  for(i=0; i<n; i++){
+    int k = p->aChildIdx[aPid[i]]++;
+    p->aChild[k] = aCid[i];
+    p->aChildPrim[k] = aPrim[i];
+    k = p->aParentIdx[aCid[i]]++;
+    p->aParent[k] = aPid[i];
+    p->aParentPrim[k] = aPrim[i];
+    p->aMtime[aCid[i]] = aTime[i];
+  }
+  /* The fill pass advanced each offset to the start of the next group.
+  ** Shift them back down by one group. */
+  for(i=p->mxRid+1; i>0; i--){
+    p->aChildIdx[i] = p->aChildIdx[i-1];
+    p->aParentIdx[i] = p->aParentIdx[i-1];
+  }
+  p->aChildIdx[0] = p->aParentIdx[0] = 0;
+  free(aPid);
+  free(aCid);
+  free(aPrim);
+  free(aTime);
+
+  /* Assign a branch id to every check-in.  Check-ins with no branch
+  ** tag, or a NULL value, are on trunk just as in the SQL version:
+  **     coalesce((SELECT value FROM tagxref ...), 'trunk')
+  */
+  p->aBranch = vcs_malloc( sizeof(int)*(p->mxRid+1) );
+  p->aBranchStart = vcs_malloc( p->mxRid+1 );
+  memset(p->aBranch, 0, sizeof(int)*(p->mxRid+1));
+  memset(p->aBranchStart, 0, p->mxRid+1);
+  db_prepare(&q,
+    "SELECT rid, coalesce(value,'trunk'), tagtype=2 AND srcid>0"
+    "  FROM tagxref WHERE tagid=%d AND rid<=%d"
+    " ORDER BY 2",
+    TAG_BRANCH, p->mxRid
+  );
+  iBranch = 0;
+  while( db_step(&q)==SQLITE_ROW ){
+    int rid = db_column_int(&q, 0);
+    const char *zValue = db_column_text(&q, 1);
+    if( zPrev==0 || vcs_strcmp(zPrev, zValue)!=0 ){
+      free(zPrevCopy);
+      zPrev = zPrevCopy = mprintf("%s", zValue);
+      iBranch++;
+    }
+    p->aBranch[rid] = vcs_strcmp(zValue, "trunk")==0 ? 0 : iBranch;
+    p->aBranchStart[rid] = db_column_int(&q, 2)!=0;
+  }
+  db_finalize(&q);
+  free(zPrevCopy);
+}
+
+/*
+** Return the in-memory DAG, loading it first if necessary.  See
+** dag_index_reset() for how it is kept up to date.
+*/
+DagIndex *dag_index(void){
+  if( !dagIsLoaded ){
+    dag_index_load(&dagIdx);
+    dagIsLoaded = 1;
+  }
+  return &dagIdx;
+}
+
+/*
+** Return true if check-ins r1 and r2 are on the same branch.
+*/
+int dag_same_branch(DagIndex *p, int r1, int r2){
+  int b1 = r1<=p->mxRid ? p->aBranch[r1] : 0;
+  int b2 = r2<=p->mxRid ? p->aBranch[r2] : 0;
+  return b1==b2;
+}
+
+/*
+** Return true if check-in rid has no children on its own branch.
+*/
+int dag_is_leaf(DagIndex *p, int rid){
+  int i;
+  if( rid<=0 || rid>p->mxRid ) return 1;
+  for(i=p->aChildIdx[rid]; i<p->aChildIdx[rid+1]; i++){
+    if( p->aBranch[p->aChild[i]]==p->aBranch[rid] ) return 0;
+  }
+  return 1;
+}
+
+/*
+** Return the number of primary children of pid on the same branch.
+*/
+int dag_count_nonbranch_children(DagIndex *p, int pid){
+  int i;
+  int cnt = 0;
+  if( pid<=0 || pid>p->mxRid ) return 0;
+  for(i=p->aChildIdx[pid]; i<p->aChildIdx[pid+1]; i++){
+    if( p->aChildPrim[i] && p->aBranch[p->aChild[i]]==p->aBranch[pid] ){
+      cnt++;
+    }
+  }
+  return cnt;
+}
+
+/*
+** COMMAND: test-dag-index
+**
+** Usage: %vcs test-dag-index ?CHECKIN?
+**
+** Load the in-memory DAG and report how long that took and how large
+** it is.  If CHECKIN is given, also time computing its leaves and up
+** to 1000 of its ancestors and descendants.
+*/
+void test_dag_index_cmd(void){
+  sqlite3_uint64 t0;
+  DagIndex *p;
+  int rid = 0;
+
+  db_find_and_open_repository(0,0);
+  if( g.argc>=3 ) rid = name_to_typed_rid(g.argv[2], "ci");
+  t0 = vcs_timer_now();
+  p = dag_index();
+  vcs_print("load:        %10.3f ms  (%d links, max rid %d)\n",
+            (vcs_timer_now()-t0)/1000.0, p->nLink, p->mxRid);
+  if( rid==0 ) return;
+  db_multi_exec("CREATE TEMP TABLE IF NOT EXISTS ok(rid INTEGER PRIMARY KEY)");
+  t0 = vcs_timer_now();
+  compute_leaves(rid, 0);
+  vcs_print("leaves:      %10.3f ms  (%d)\n", (vcs_timer_now()-t0)/1000.0,
+            db_int(0, "SELECT count(*) FROM leaves"));
+  db_multi_exec("DELETE FROM ok");
+  t0 = vcs_timer_now();
+  compute_ancestors(rid, 1000);
+  vcs_print("ancestors:   %10.3f ms  (%d)\n", (vcs_timer_now()-t0)/1000.0,
+            db_int(0, "SELECT count(*) FROM ok"));
+  db_multi_exec("DELETE FROM ok");
+  t0 = vcs_timer_now();
+  compute_descendants(rid, 1000);
+  vcs_print("descendants: %10.3f ms  (%d)\n", (vcs_timer_now()-t0)/1000.0,
+            db_int(0, "SELECT count(*) FROM ok"));
+}
@@ -55,6 +55,12 @@ typedef unsigned int u32;
 typedef short int s16;
 typedef unsigned short int u16;
 
+/*
+** Must be a signed 64-bit value.  Sizes and offsets within the source,
+** target and delta use this type so that files larger than 4GB work.
+*/
+typedef long long int s64;
+
 #endif /* INTERFACE */
 
 /*
@@ -63,6 +69,13 @@ typedef unsigned short int u16;
 */
 #define NHASH 16
 
+/*
+** The largest number of landmarks taken from the source file.  Above
+** NHASH*MX_LANDMARK bytes of source, landmarks are spaced further apart
+** so that the hash table stays within 2*MX_LANDMARK integers.
+*/
+#define MX_LANDMARK (1<<24)
+
 /*
 ** The current state of the rolling hash.
 **
@@ -119,7 +132,7 @@ static u32 hash_32bit(hash *pHash){
 /*
 ** Write an base-64 integer into the given buffer.
 */
-static void putInt(unsigned int v, char **pz){
+static void putInt(s64 v, char **pz){
   static const char zDigits[] = 
     "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz~";
   /*  123456789 123456789 123456789 123456789 123456789 123456789 123 */
@@ -142,8 +155,10 @@ static void putInt(unsigned int v, char **pz){
 ** finished, leave *pz pointing to the first character past the end of
 ** the integer.  The *pLen parameter holds the length of the string
 ** in *pz and is decremented once for each character in the integer.
+**
+** Return -1 if the integer is too large to be a valid size or offset.
 */
-static unsigned int getInt(const char **pz, int *pLen){
+static s64 getInt(const char **pz, s64 *pLen){
   static const signed char zValue[] = {
     -1, -1, -1, -1, -1, -1, -1, -1,   -1, -1, -1, -1, -1, -1, -1, -1,
     -1, -1, -1, -1, -1, -1, -1, -1,   -1, -1, -1, -1, -1, -1, -1, -1,
@@ -154,11 +169,12 @@ static unsigned int getInt(const char **pz, int *pLen){
     -1, 37, 38, 39, 40, 41, 42, 43,   44, 45, 46, 47, 48, 49, 50, 51,
     52, 53, 54, 55, 56, 57, 58, 59,   60, 61, 62, -1, -1, -1, 63, -1,
   };
-  unsigned int v = 0;
+  s64 v = 0;
   int c;
   unsigned char *z = (unsigned char*)*pz;
   unsigned char *zStart = z;
   while( (c = zValue[0x7f&*(z++)])>=0 ){
+     if( v>=((s64)1<<56) ) return -1;
      v = (v<<6) + c;
   }
   z--;
@@ -170,9 +186,9 @@ static unsigned int getInt(const char **pz, int *pLen){
 /*
 ** Return the number digits in the base-64 representation of a positive integer
 */
-static int digit_count(int v){
-  unsigned int i, x;
-  for(i=1, x=64; v>=x; i++, x <<= 6){}
+static int digit_count(s64 v){
+  int i;
+  for(i=1; v>=64; i++, v >>= 6){}
   return i;
 }
 
@@ -214,20 +230,21 @@ static unsigned int checksum(const char *zIn, size_t N){
 /*
 ** Create a new delta.
 */
-int delta_create(
+s64 delta_create(
   const char *zSrc,      /* The source or pattern file */
-  unsigned int lenSrc,   /* Length of the source file */
+  s64 lenSrc,            /* Length of the source file */
   const char *zOut,      /* The target file */
-  unsigned int lenOut,   /* Length of the target file */
+  s64 lenOut,            /* Length of the target file */
   char *zDelta           /* Write the delta into this buffer */
 ){
-  int i, base;
+  s64 i, base;
   char *zOrigDelta = zDelta;
   hash h;
   int nHash;                 /* Number of hash table entries */
+  s64 stride;                /* Distance between landmarks in zSrc */
   int *landmark;             /* Primary hash table */
   int *collide;              /* Collision chain */
-  int lastRead = -1;         /* Last byte of zSrc read by a COPY command */
+  s64 lastRead = -1;         /* Last byte of zSrc read by a COPY command */
 
   /* Add the target file size to the beginning of the delta
   */
@@ -251,17 +268,19 @@ int delta_create(
   /* Compute the hash table used to locate matching sections in the
   ** source file.
   */
-  nHash = lenSrc/NHASH;
+  stride = NHASH;
+  while( lenSrc/stride>MX_LANDMARK ) stride <<= 1;
+  nHash = lenSrc/stride;
   collide = vcs_malloc( nHash*2*sizeof(int) );
   landmark = &collide[nHash];
   memset(landmark, -1, nHash*sizeof(int));
   memset(collide, -1, nHash*sizeof(int));
-  for(i=0; i<lenSrc-NHASH; i+=NHASH){
+  for(i=0; i<lenSrc-NHASH; i+=stride){
     int hv;
     hash_init(&h, &zSrc[i]);
     hv = hash_32bit(&h) % nHash;
-    collide[i/NHASH] = landmark[hv];
-    landmark[hv] = i/NHASH;
+    collide[i/stride] = landmark[hv];
+    landmark[hv] = i/stride;
   }
 
   /* Begin scanning the target file and generating copy commands and
@@ -269,8 +288,9 @@ int delta_create(
   */
   base = 0;    /* We have already generated everything before zOut[base] */
   while( base+NHASH<lenOut ){
-    int iSrc, iBlock;
-    unsigned int bestCnt, bestOfst=0, bestLitsz=0;
+    s64 iSrc;
+    int iBlock;
+    s64 bestCnt, bestOfst=0, bestLitsz=0;
     hash_init(&h, &zOut[base]);
     i = 0;     /* Trying to match a landmark against zOut[base+i] */
     bestCnt = 0;
@@ -279,20 +299,20 @@ int delta_create(
       int limit = 250;
 
       hv = hash_32bit(&h) % nHash;
-      DEBUG2( printf("LOOKING: %4d [%s]\n", base+i, print16(&zOut[base+i])); )
+      DEBUG2( printf("LOOKING: %4lld [%s]\n", base+i, print16(&zOut[base+i])); )
       iBlock = landmark[hv];
       while( iBlock>=0 && (limit--)>0 ){
         /*
         ** The hash window has identified a potential match against 
         ** landmark block iBlock.  But we need to investigate further.
         */
-        int cnt, ofst, litsz;
-        int j, k, x, y;
+        s64 cnt, ofst, litsz;
+        s64 j, k, x, y;
         int sz;
 
         /* Beginning at iSrc, match forwards as far as we can.  j counts
         ** the number of characters that match */
-        iSrc = iBlock*NHASH;
+        iSrc = iBlock*stride;
         for(j=0, x=iSrc, y=base+i; x<lenSrc && y<lenOut; j++, x++, y++){
           if( zSrc[x]!=zOut[y] ) break;
         }
@@ -309,7 +329,7 @@ int delta_create(
         ofst = iSrc-k;
         cnt = j+k+1;
         litsz = i-k;  /* Number of bytes of literal text before the copy */
-        DEBUG2( printf("MATCH %d bytes at %d: [%s] litsz=%d\n",
+        DEBUG2( printf("MATCH %lld bytes at %lld: [%s] litsz=%lld\n",
                         cnt, ofst, print16(&zSrc[ofst]), litsz); )
         /* sz will hold the number of bytes needed to encode the "insert"
         ** command and the copy command, not counting the "insert" text */
@@ -338,17 +358,17 @@ int delta_create(
           memcpy(zDelta, &zOut[base], bestLitsz);
           zDelta += bestLitsz;
           base += bestLitsz;
-          DEBUG2( printf("insert %d\n", bestLitsz); )
+          DEBUG2( printf("insert %lld\n", bestLitsz); )
         }
         base += bestCnt;
         putInt(bestCnt, &zDelta);
         *(zDelta++) = '@';
         putInt(bestOfst, &zDelta);
-        DEBUG2( printf("copy %d bytes from %d\n", bestCnt, bestOfst); )
+        DEBUG2( printf("copy %lld bytes from %lld\n", bestCnt, bestOfst); )
         *(zDelta++) = ',';
         if( bestOfst + bestCnt -1 > lastRead ){
           lastRead = bestOfst + bestCnt - 1;
-          DEBUG2( printf("lastRead becomes %d\n", lastRead); )
+          DEBUG2( printf("lastRead becomes %lld\n", lastRead); )
         }
         bestCnt = 0;
         break;
@@ -391,8 +411,8 @@ int delta_create(
 ** Return the size (in bytes) of the output from applying
 ** a delta. 
 */
-int delta_output_size(const char *zDelta, int lenDelta){
-  int size;
+s64 delta_output_size(const char *zDelta, s64 lenDelta){
+  s64 size;
   size = getInt(&zDelta, &lenDelta);
   if( *zDelta!='\n' ){
     /* ERROR: size integer not terminated by "\n" */
@@ -405,38 +425,46 @@ int delta_output_size(const char *zDelta, int lenDelta){
 /*
 ** Apply a delta.
 */
-int delta_apply(
+s64 delta_apply(
   const char *zSrc,      /* The source or pattern file */
-  int lenSrc,            /* Length of the source file */
+  s64 lenSrc,            /* Length of the source file */
   const char *zDelta,    /* Delta to apply to the pattern */
-  int lenDelta,          /* Length of the delta */
+  s64 lenDelta,          /* Length of the delta */
   char *zOut             /* Write the output into this preallocated buffer */
 ){
-  unsigned int limit;
-  unsigned int total = 0;
+  s64 limit;
+  s64 total = 0;
 #ifndef vcs_OMIT_DELTA_CKSUM_TEST
   char *zOrigOut = zOut;
 #endif
 
   limit = getInt(&zDelta, &lenDelta);
-  if( *zDelta!='\n' ){
+  if( limit<0 || *zDelta!='\n' ){
     /* ERROR: size integer not terminated by "\n" */
     return -1;
   }
   zDelta++; lenDelta--;
   while( *zDelta && lenDelta>0 ){
-    unsigned int cnt, ofst;
+    s64 cnt, ofst;
     cnt = getInt(&zDelta, &lenDelta);
+    if( cnt<0 ){
+      /* ERROR: integer overflow */
+      return -1;
+    }
     switch( zDelta[0] ){
       case '@': {
         zDelta++; lenDelta--;
         ofst = getInt(&zDelta, &lenDelta);
+        if( ofst<0 ){
+          /* ERROR: integer overflow */
+          return -1;
+        }
         if( lenDelta>0 && zDelta[0]!=',' ){
           /* ERROR: copy command not terminated by ',' */
           return -1;
         }
         zDelta++; lenDelta--;
-        DEBUG1( printf("COPY %d from %d\n", cnt, ofst); )
+        DEBUG1( printf("COPY %lld from %lld\n", cnt, ofst); )
         total += cnt;
         if( total>limit ){
           /* ERROR: copy exceeds output file size */
@@ -457,7 +485,7 @@ int delta_apply(
           /* ERROR:  insert command gives an output larger than predicted */
           return -1;
         }
-        DEBUG1( printf("INSERT %d\n", cnt); )
+        DEBUG1( printf("INSERT %lld\n", cnt); )
         if( cnt>lenDelta ){
           /* ERROR: insert count exceeds size of delta */
           return -1;
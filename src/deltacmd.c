@@ -11,18 +11,19 @@
 */
 int blob_delta_create(Blob *pOriginal, Blob *pTarget, Blob *pDelta){
   const char *zOrig, *zTarg;
-  int lenOrig, lenTarg;
-  int len;
+  i64 lenOrig, lenTarg;
+  i64 len;
   char *zRes;
   blob_zero(pDelta);
   zOrig = blob_buffer(pOriginal);
   lenOrig = blob_size(pOriginal);
   zTarg = blob_buffer(pTarget);
   lenTarg = blob_size(pTarget);
-  blob_resize(pDelta, lenTarg+16);
+  blob_resize(pDelta, lenTarg+40);
   zRes = blob_buffer(pDelta);
   len = delta_create(zOrig, lenOrig, zTarg, lenTarg, zRes);
   blob_resize(pDelta, len);
+  blob_shrink_to_fit(pDelta);
   return 0;
 }
 
@@ -31,8 +32,8 @@ int blob_delta_create(Blob *pOriginal, Blob *pTarget, Blob *pDelta){
 ** the target file pTarget.  The pTarget blob is initialized by this
 ** routine.
 */
-int blob_delta_apply(Blob *pOriginal, Blob *pDelta, Blob *pTarget){
-  int len, n;
+i64 blob_delta_apply(Blob *pOriginal, Blob *pDelta, Blob *pTarget){
+  i64 len, n;
   Blob out;
 
   n = delta_output_size(blob_buffer(pDelta), blob_size(pDelta));
@@ -45,65 +45,47 @@ void compute_leaves(int iBase, int closeMode){
   );
 
   if( iBase>0 ){
+    DagIndex *pDag = dag_index();
     Bag seen;     /* Descendants seen */
     Bag pending;  /* Unpropagated descendants */
-    Stmt q1;      /* Query to find children of a check-in */
-    Stmt isBr;    /* Query to check to see if a check-in starts a new branch */
     Stmt ins;     /* INSERT statement for a new record */
 
-    /* Initialize the bags. */
-    bag_init(&seen);
-    bag_init(&pending);
+    /* Initialize the bags.  Rids are dense, so use bitmaps. */
+    bag_init_dense(&seen);
+    bag_init_dense(&pending);
     bag_insert(&pending, iBase);
 
-    /* This query returns all non-branch-merge children of check-in :rid.
-    **
-    ** If a a child is a merge of a fork within the same branch, it is 
-    ** returned.  Only merge children in different branches are excluded.
-    */
-    db_prepare(&q1,
-      "SELECT cid FROM plink"
-      " WHERE pid=:rid"
-      "   AND (isprim"
-      "        OR coalesce((SELECT value FROM tagxref"
-                        "   WHERE tagid=%d AND rid=plink.pid), 'trunk')"
-                 "=coalesce((SELECT value FROM tagxref"
-                        "   WHERE tagid=%d AND rid=plink.cid), 'trunk'))",
-      TAG_BRANCH, TAG_BRANCH
-    );
-  
-    /* This query returns a single row if check-in :rid is the first
-    ** check-in of a new branch.
-    */
-    db_prepare(&isBr, 
-       "SELECT 1 FROM tagxref"
-       " WHERE rid=:rid AND tagid=%d AND tagtype=2"
-       "   AND srcid>0",
-       TAG_BRANCH
-    );
-  
     /* This statement inserts check-in :rid into the LEAVES table.
     */
     db_prepare(&ins, "INSERT OR IGNORE INTO leaves VALUES(:rid)");
   
     while( bag_count(&pending) ){
-      int rid = bag_first(&pending);
+      int rid = bag_pop(&pending);
       int cnt = 0;
-      bag_remove(&pending, rid);
-      db_bind_int(&q1, ":rid", rid);
-      while( db_step(&q1)==SQLITE_ROW ){
-        int cid = db_column_int(&q1, 0);
-        if( bag_insert(&seen, cid) ){
-          bag_insert(&pending, cid);
-        }
-        db_bind_int(&isBr, ":rid", cid);
-        if( db_step(&isBr)==SQLITE_DONE ){
-          cnt++;
+      int i;
+
+      /* Visit all non-branch-merge children of check-in rid.
+      **
+      ** If a a child is a merge of a fork within the same branch, it is 
+      ** visited.  Only merge children in different branches are excluded.
+      ** A child counts against rid being a leaf unless it is the first
+      ** check-in of a new branch.
+      */
+      if( rid<=pDag->mxRid ){
+        for(i=pDag->aChildIdx[rid]; i<pDag->aChildIdx[rid+1]; i++){
+          int cid = pDag->aChild[i];
+          if( !pDag->aChildPrim[i] && !dag_same_branch(pDag, rid, cid) ){
+            continue;
+          }
+          if( bag_insert(&seen, cid) ){
+            bag_insert(&pending, cid);
+          }
+          if( !pDag->aBranchStart[cid] ){
+            cnt++;
+          }
         }
-        db_reset(&isBr);
       }
-      db_reset(&q1);
-      if( cnt==0 && !is_a_leaf(rid) ){
+      if( cnt==0 && !dag_is_leaf(pDag, rid) ){
         cnt++;
       }
       if( cnt==0 ){
@@ -113,8 +95,6 @@ void compute_leaves(int iBase, int closeMode){
       }
     }
     db_finalize(&ins);
-    db_finalize(&isBr);
-    db_finalize(&q1);
     bag_clear(&pending);
     bag_clear(&seen);
   }
@@ -144,37 +124,31 @@ void compute_leaves(int iBase, int closeMode){
 ** the "ok" table.
 */
 void compute_ancestors(int rid, int N){
+  DagIndex *pDag = dag_index();
   Bag seen;
   PQueue queue;
   Stmt ins;
-  Stmt q;
-  bag_init(&seen);
+  bag_init_dense(&seen);
   pqueue_init(&queue);
   bag_insert(&seen, rid);
   pqueue_insert(&queue, rid, 0.0, 0);
   db_prepare(&ins, "INSERT OR IGNORE INTO ok VALUES(:rid)");
-  db_prepare(&q,
-    "SELECT a.pid, b.mtime FROM plink a LEFT JOIN plink b ON b.cid=a.pid"
-    " WHERE a.cid=:rid"
-  );
   while( (N--)>0 && (rid = pqueue_extract(&queue, 0))!=0 ){
+    int i;
     db_bind_int(&ins, ":rid", rid);
     db_step(&ins);
     db_reset(&ins);
-    db_bind_int(&q, ":rid", rid);
-    while( db_step(&q)==SQLITE_ROW ){
-      int pid = db_column_int(&q, 0);
-      double mtime = db_column_double(&q, 1);
+    if( rid>pDag->mxRid ) continue;
+    for(i=pDag->aParentIdx[rid]; i<pDag->aParentIdx[rid+1]; i++){
+      int pid = pDag->aParent[i];
       if( bag_insert(&seen, pid) ){
-        pqueue_insert(&queue, pid, -mtime, 0);
+        pqueue_insert(&queue, pid, -pDag->aMtime[pid], 0);
       }
     }
-    db_reset(&q);
   }
   bag_clear(&seen);
   pqueue_clear(&queue);
   db_finalize(&ins);
-  db_finalize(&q);
 }
 
 /*
@@ -218,35 +192,32 @@ void compute_direct_ancestors(int rid, int N){
 ** the "ok" table.
 */
 void compute_descendants(int rid, int N){
+  DagIndex *pDag = dag_index();
   Bag seen;
   PQueue queue;
   Stmt ins;
-  Stmt q;
 
-  bag_init(&seen);
+  bag_init_dense(&seen);
   pqueue_init(&queue);
   bag_insert(&seen, rid);
   pqueue_insert(&queue, rid, 0.0, 0);
   db_prepare(&ins, "INSERT OR IGNORE INTO ok VALUES(:rid)");
-  db_prepare(&q, "SELECT cid, mtime FROM plink WHERE pid=:rid");
   while( (N--)>0 && (rid = pqueue_extract(&queue, 0))!=0 ){
+    int i;
     db_bind_int(&ins, ":rid", rid);
     db_step(&ins);
     db_reset(&ins);
-    db_bind_int(&q, ":rid", rid);
-    while( db_step(&q)==SQLITE_ROW ){
-      int pid = db_column_int(&q, 0);
-      double mtime = db_column_double(&q, 1);
-      if( bag_insert(&seen, pid) ){
-        pqueue_insert(&queue, pid, mtime, 0);
+    if( rid>pDag->mxRid ) continue;
+    for(i=pDag->aChildIdx[rid]; i<pDag->aChildIdx[rid+1]; i++){
+      int cid = pDag->aChild[i];
+      if( bag_insert(&seen, cid) ){
+        pqueue_insert(&queue, cid, pDag->aMtime[cid], 0);
       }
     }
-    db_reset(&q);
   }
   bag_clear(&seen);
   pqueue_clear(&queue);
   db_finalize(&ins);
-  db_finalize(&q);
 }
 
 /*
@@ -223,6 +223,8 @@ static void diff_all_against_disk(
   Blob sql;
   Stmt q;
   int asNewFile;            /* Treat non-existant files as empty files */
+  Arena *pArena;            /* Memory for the names of the files */
+  ArenaMark mark;           /* Rewind to here for each file */
 
   asNewFile = (diffFlags & DIFF_NEWFILE)!=0;
   vid = db_lget_int("checkout", 0);
@@ -266,6 +268,8 @@ static void diff_all_against_disk(
     );
   }
   db_prepare(&q, blob_str(&sql));
+  pArena = arena_default();
+  mark = arena_mark(pArena);
   while( db_step(&q)==SQLITE_ROW ){
     const char *zPathname = db_column_text(&q,0);
     int isDeleted = db_column_int(&q, 1);
@@ -273,9 +277,10 @@ static void diff_all_against_disk(
     int isNew = db_column_int(&q,3);
     int srcid = db_column_int(&q, 4);
     int isLink = db_column_int(&q, 5);
-    char *zFullName = mprintf("%s%s", g.zLocalRoot, zPathname);
-    char *zToFree = zFullName;
+    const char *zFullName;
     int showDiff = 1;
+    arena_rewind(pArena, mark);
+    zFullName = arena_mprintf(pArena, "%s%s", g.zLocalRoot, zPathname);
     if( isDeleted ){
       vcs_print("DELETED  %s\n", zPathname);
       if( !asNewFile ){ showDiff = 0; zFullName = NULL_DEVICE; }
@@ -309,8 +314,8 @@ static void diff_all_against_disk(
       diff_file(&content, zFullName, zPathname, zDiffCmd, diffFlags);
       blob_reset(&content);
     }
-    free(zToFree);
   }
+  arena_rewind(pArena, mark);
   db_finalize(&q);
   db_end_transaction(1);  /* ROLLBACK */
 }
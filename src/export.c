@@ -178,7 +178,7 @@ void export_cmd(void){
       db_bind_int(&q2, ":rid", rid);
       db_step(&q2);
       db_reset(&q2);
-      printf("blob\nmark :%d\ndata %d\n", BLOBMARK(rid), blob_size(&content));
+      printf("blob\nmark :%d\ndata %lld\n", BLOBMARK(rid), (long long)blob_size(&content));
       bag_insert(&blobs, rid);
       fwrite(blob_buffer(&content), 1, blob_size(&content), stdout);
       printf("\n");
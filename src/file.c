@@ -85,6 +85,63 @@ static int getStat(const char *zFilename, int isWd){
   return rc;
 }
 
+#if INTERFACE
+/*
+** Everything a loop over the files of a checkout usually wants to know
+** about one file, as filled in by file_wd_stat() from a single stat()
+** or lstat().
+*/
+struct FileStat {
+  i64 size;              /* Size in bytes.  -1 if the file does not exist */
+  i64 mtime;             /* Modification time in seconds.  -1 if missing */
+  i64 mtimeNs;           /* Modification time in nanoseconds */
+  i64 inode;             /* Inode number.  Always 0 on Windows */
+  unsigned int mode;     /* st_mode of the file */
+  int perm;              /* PERM_REG, PERM_EXE or PERM_LNK */
+  char isDir;            /* True for a directory */
+  char isFileOrLink;     /* True for an ordinary file or a symlink */
+};
+#endif
+
+/*
+** Fill in *pStat for the file zFilename, taking symlinks into account
+** as the file_wd_* routines do.  This makes a single stat() or lstat()
+** call, rather than one for each of the file_wd_* routines.  The result
+** also becomes the most recently stat-ed file for those routines.
+**
+** Return 0 on success.  If the file does not exist return 1, with the
+** size and mtime of *pStat set to -1.
+*/
+int file_wd_stat(const char *zFilename, FileStat *pStat){
+  memset(pStat, 0, sizeof(*pStat));
+  if( getStat(zFilename, 1) ){
+    pStat->size = -1;
+    pStat->mtime = -1;
+    pStat->mtimeNs = -1;
+    pStat->perm = PERM_REG;
+    return 1;
+  }
+  pStat->size = fileStat.st_size;
+  pStat->mtime = fileStat.st_mtime;
+#if defined(_WIN32)
+  pStat->mtimeNs = (i64)fileStat.st_mtime*1000000000;
+#elif defined(__APPLE__)
+  pStat->mtimeNs = (i64)fileStat.st_mtimespec.tv_sec*1000000000
+                       + fileStat.st_mtimespec.tv_nsec;
+#else
+  pStat->mtimeNs = (i64)fileStat.st_mtim.tv_sec*1000000000
+                       + fileStat.st_mtim.tv_nsec;
+#endif
+#if !defined(_WIN32)
+  pStat->inode = fileStat.st_ino;
+#endif
+  pStat->mode = fileStat.st_mode;
+  pStat->perm = file_mode_perm(fileStat.st_mode);
+  pStat->isDir = S_ISDIR(fileStat.st_mode)!=0;
+  pStat->isFileOrLink = S_ISREG(fileStat.st_mode) || S_ISLNK(fileStat.st_mode);
+  return 0;
+}
+
 /*
 ** Return the size of a file in bytes.  Return -1 if the file does not
 ** exist.  If zFilename is NULL, return the size of the most recently
@@ -205,19 +262,28 @@ void symlink_copy(const char *zFrom, const char *zTo){
 */
 int file_wd_perm(const char *zFilename){
   if( getStat(zFilename, 1) ) return PERM_REG;
+  return file_mode_perm(fileStat.st_mode);
+}
+
+/*
+** Return the permission file_wd_perm() reports for a file whose stat()
+** or lstat() mode is mode.  Directory walkers that already have the
+** mode at hand use this to avoid a second stat() of the file.
+*/
+int file_mode_perm(unsigned int mode){
 #if defined(_WIN32)
 #  if defined(__DMC__) || defined(_MSC_VER)
 #    define S_IXUSR  _S_IEXEC
 #  endif
-  if( S_ISREG(fileStat.st_mode) && ((S_IXUSR)&fileStat.st_mode)!=0 )
+  if( S_ISREG(mode) && ((S_IXUSR)&mode)!=0 )
     return PERM_EXE;
   else
     return PERM_REG;
 #else
-  if( S_ISREG(fileStat.st_mode) && 
-      ((S_IXUSR|S_IXGRP|S_IXOTH)&fileStat.st_mode)!=0 )
+  if( S_ISREG(mode) && 
+      ((S_IXUSR|S_IXGRP|S_IXOTH)&mode)!=0 )
     return PERM_EXE;
-  else if( g.allowSymlinks && S_ISLNK(fileStat.st_mode) )
+  else if( g.allowSymlinks && S_ISLNK(mode) )
     return PERM_LNK;
   else
     return PERM_REG;
@@ -350,19 +416,30 @@ void file_copy(const char *zFrom, const char *zTo){
 ** occurred and false if this routine is a no-op.
 */
 int file_wd_setexe(const char *zFilename, int onoff){
+  FileStat st;
+  if( file_wd_stat(zFilename, &st) ) return 0;
+  return file_stat_setexe(zFilename, &st, onoff);
+}
+
+/*
+** Same as file_wd_setexe() for a file that file_wd_stat() has already
+** filled in *pStat for, so that the file is not stat-ed again.  The
+** modification time of the file is not changed.
+*/
+int file_stat_setexe(const char *zFilename, const FileStat *pStat, int onoff){
   int rc = 0;
 #if !defined(_WIN32)
-  struct stat buf;
-  if( vcs_stat(zFilename, &buf, 1)!=0 || S_ISLNK(buf.st_mode) ) return 0;
+  unsigned int mode = pStat->mode;
+  if( pStat->size<0 || S_ISLNK(mode) ) return 0;
   if( onoff ){
-    int targetMode = (buf.st_mode & 0444)>>2;
-    if( (buf.st_mode & 0111)!=targetMode ){
-      chmod(zFilename, buf.st_mode | targetMode);
+    int targetMode = (mode & 0444)>>2;
+    if( (mode & 0111)!=targetMode ){
+      chmod(zFilename, mode | targetMode);
       rc = 1;
     }
   }else{
-    if( (buf.st_mode & 0111)!=0 ){
-      chmod(zFilename, buf.st_mode & ~0111);
+    if( (mode & 0111)!=0 ){
+      chmod(zFilename, mode & ~0111);
       rc = 1;
     }
   }
@@ -579,46 +656,106 @@ int file_is_absolute_path(const char *zPath){
 }
 
 /*
-** Compute a canonical pathname for a file or directory.
-** Make the name absolute if it is relative.
-** Remove redundant / characters
-** Remove all /./ path elements.
-** Convert /A/../ to just /
-** If the slash parameter is non-zero, the trailing slash, if any,
-** is retained.
+** Names are made canonical many times over in a single command, once
+** for each file named on the command line for example, and neither the
+** working directory nor the root of the checkout change in between.  So
+** both are looked up once and kept here.
 */
-void file_canonical_name(const char *zOrigName, Blob *pOut, int slash){
-  if( file_is_absolute_path(zOrigName) ){
-#if defined(_WIN32)
-    char *zOut;
-#endif
-    blob_set(pOut, zOrigName);
-    blob_materialize(pOut);
+static struct {
+  char *zPwd;            /* Working directory, or NULL if not looked up */
+  int nPwd;              /* Length of zPwd */
+  char *zRootFor;        /* Copy of the g.zLocalRoot that zRoot is for */
+  char *zRoot;           /* Canonical name of zRootFor, ending with "/" */
+  int nRoot;             /* Length of zRoot */
+} fileNameCache;
+
+/*
+** Forget the cached working directory and checkout root.  This must be
+** called after the working directory changes.
+*/
+void file_name_cache_reset(void){
+  free(fileNameCache.zPwd);
+  free(fileNameCache.zRootFor);
+  free(fileNameCache.zRoot);
+  memset(&fileNameCache, 0, sizeof(fileNameCache));
+}
+
+/*
+** Return the current working directory, as from file_getcwd().  On
+** Windows the drive letter is converted to upper case.  Store its length
+** in *pnPwd.
+*/
+static const char *file_cached_cwd(int *pnPwd){
+  if( fileNameCache.zPwd==0 ){
+    char zPwd[2000];
+    file_getcwd(zPwd, sizeof(zPwd));
 #if defined(_WIN32)
-    /*
-    ** On Windows, normalize the drive letter to upper case.
-    */
-    zOut = blob_str(pOut);
-    if( vcs_isalpha(zOut[0]) && zOut[1]==':' ){
-      zOut[0] = vcs_toupper(zOut[0]);
+    if( vcs_isalpha(zPwd[0]) && zPwd[1]==':' ){
+      zPwd[0] = vcs_toupper(zPwd[0]);
     }
 #endif
-  }else{
-    char zPwd[2000];
-    file_getcwd(zPwd, sizeof(zPwd)-strlen(zOrigName));
+    fileNameCache.nPwd = strlen(zPwd);
+    fileNameCache.zPwd = mprintf("%s", zPwd);
+  }
+  *pnPwd = fileNameCache.nPwd;
+  return fileNameCache.zPwd;
+}
+
+/*
+** Write the canonical name of zOrigName into zBuf[], which has room for
+** nBuf bytes, and return its length.  Return -1 without writing anything
+** if the name does not fit.  See file_canonical_name().
+*/
+static int file_canonical_name_buf(
+  const char *zOrigName,   /* Name to make canonical */
+  char *zBuf,              /* Write the canonical name here */
+  int nBuf,                /* Bytes of space in zBuf[] */
+  int slash                /* Retain a trailing slash */
+){
+  int nOrig = strlen(zOrigName);
+  int n;
+  if( file_is_absolute_path(zOrigName) ){
+    if( nOrig>=nBuf ) return -1;
+    memcpy(zBuf, zOrigName, nOrig+1);
+    n = nOrig;
 #if defined(_WIN32)
     /*
     ** On Windows, normalize the drive letter to upper case.
     */
-    if( vcs_isalpha(zPwd[0]) && zPwd[1]==':' ){
-      zPwd[0] = vcs_toupper(zPwd[0]);
+    if( vcs_isalpha(zBuf[0]) && zBuf[1]==':' ){
+      zBuf[0] = vcs_toupper(zBuf[0]);
     }
 #endif
-    blob_zero(pOut);
-    blob_appendf(pOut, "%//%/", zPwd, zOrigName);
+  }else{
+    int nPwd;
+    const char *zPwd = file_cached_cwd(&nPwd);
+    if( nPwd+1+nOrig>=nBuf ) return -1;
+    memcpy(zBuf, zPwd, nPwd);
+    zBuf[nPwd] = '/';
+    memcpy(&zBuf[nPwd+1], zOrigName, nOrig+1);
+    n = nPwd+1+nOrig;
   }
-  blob_resize(pOut, file_simplify_name(blob_buffer(pOut),
-                                       blob_size(pOut), slash));
+  return file_simplify_name(zBuf, n, slash);
+}
+
+/*
+** Compute a canonical pathname for a file or directory.
+** Make the name absolute if it is relative.
+** Remove redundant / characters
+** Remove all /./ path elements.
+** Convert /A/../ to just /
+** If the slash parameter is non-zero, the trailing slash, if any,
+** is retained.
+*/
+void file_canonical_name(const char *zOrigName, Blob *pOut, int slash){
+  int nPwd = 0;
+  int nBuf;
+  if( !file_is_absolute_path(zOrigName) ) file_cached_cwd(&nPwd);
+  nBuf = nPwd + strlen(zOrigName) + 2;
+  blob_zero(pOut);
+  blob_resize(pOut, nBuf);
+  blob_resize(pOut, file_canonical_name_buf(zOrigName, blob_buffer(pOut),
+                                            nBuf, slash));
 }
 
 /*
@@ -671,12 +808,9 @@ void file_relative_name(const char *zOrigName, Blob *pOut, int slash){
   zPath = file_without_drive_letter(blob_buffer(pOut));
   if( zPath[0]=='/' ){
     int i, j;
+    int nPwd;
     Blob tmp;
-    char *zPwd;
-    char zBuf[2000];
-    zPwd = zBuf;
-    file_getcwd(zBuf, sizeof(zBuf)-20);
-    zPwd = file_without_drive_letter(zBuf);
+    char *zPwd = file_without_drive_letter((char*)file_cached_cwd(&nPwd));
     i = 1;
 #ifdef _WIN32
     while( zPath[i] && vcs_tolower(zPwd[i])==vcs_tolower(zPath[i]) ) i++;
@@ -717,6 +851,28 @@ void file_relative_name(const char *zOrigName, Blob *pOut, int slash){
   }
 }
 
+/*
+** Return the canonical name of the root of the local tree, which ends
+** with a "/", and store its length in *pnRoot.  The name is only worked
+** out again if g.zLocalRoot changes.
+*/
+static const char *file_cached_root(int *pnRoot){
+  if( fileNameCache.zRootFor==0
+   || strcmp(fileNameCache.zRootFor, g.zLocalRoot)!=0
+  ){
+    Blob root;
+    free(fileNameCache.zRootFor);
+    free(fileNameCache.zRoot);
+    file_canonical_name(g.zLocalRoot, &root, 1);
+    fileNameCache.zRootFor = mprintf("%s", g.zLocalRoot);
+    fileNameCache.nRoot = blob_size(&root);
+    fileNameCache.zRoot = mprintf("%s", blob_str(&root));
+    blob_reset(&root);
+  }
+  *pnRoot = fileNameCache.nRoot;
+  return fileNameCache.zRoot;
+}
+
 /*
 ** Compute a pathname for a file relative to the root of the local
 ** tree.  Return TRUE on success.  On failure, print and error
@@ -724,45 +880,97 @@ void file_relative_name(const char *zOrigName, Blob *pOut, int slash){
 ** false, then simply return 0.
 **
 ** The root of the tree is defined by the g.zLocalRoot variable.
+**
+** The canonical name is built on the stack, so the only memory
+** allocated is for the result in pOut.
 */
 int file_tree_name(const char *zOrigName, Blob *pOut, int errFatal){
-  Blob localRoot;
   int nLocalRoot;
-  char *zLocalRoot;
+  const char *zLocalRoot;
+  char zBuf[2000];
   Blob full;
   int nFull;
   char *zFull;
+  int rc = 1;
 
   blob_zero(pOut);
   db_must_be_within_tree();
-  file_canonical_name(g.zLocalRoot, &localRoot, 1);
-  nLocalRoot = blob_size(&localRoot);
-  zLocalRoot = blob_buffer(&localRoot);
+  zLocalRoot = file_cached_root(&nLocalRoot);
   assert( nLocalRoot>0 && zLocalRoot[nLocalRoot-1]=='/' );
-  file_canonical_name(zOrigName, &full, 0);
-  nFull = blob_size(&full);
-  zFull = blob_buffer(&full);
+  blob_zero(&full);
+  nFull = file_canonical_name_buf(zOrigName, zBuf, sizeof(zBuf), 0);
+  if( nFull>=0 ){
+    zFull = zBuf;
+  }else{
+    file_canonical_name(zOrigName, &full, 0);
+    nFull = blob_size(&full);
+    zFull = blob_buffer(&full);
+  }
 
-  /* Special case.  zOrigName refers to g.zLocalRoot directory. */
   if( nFull==nLocalRoot-1 && memcmp(zLocalRoot, zFull, nFull)==0 ){
+    /* Special case.  zOrigName refers to g.zLocalRoot directory. */
     blob_append(pOut, ".", 1);
-    blob_reset(&localRoot);
-    blob_reset(&full);
-    return 1;
+  }else if( nFull<=nLocalRoot || memcmp(zLocalRoot, zFull, nLocalRoot) ){
+    rc = 0;
+  }else{
+    blob_append(pOut, &zFull[nLocalRoot], nFull-nLocalRoot);
+  }
+  blob_reset(&full);
+  if( rc==0 && errFatal ){
+    vcs_fatal("file outside of checkout tree: %s", zOrigName);
   }
+  return rc;
+}
 
-  if( nFull<=nLocalRoot || memcmp(zLocalRoot, zFull, nLocalRoot) ){
-    blob_reset(&localRoot);
-    blob_reset(&full);
-    if( errFatal ){
-      vcs_fatal("file outside of checkout tree: %s", zOrigName);
+/*
+** COMMAND: test-tree-name-benchmark
+**
+** Usage: %vcs test-tree-name-benchmark ?OPTIONS? ?FILE ...?
+**
+** Time file_tree_name() over the FILE arguments, as a command given a
+** long list of files would call it, and print the result.  Run this
+** from within a checkout.  Options:
+**
+**    --generate N    Also use N made up names, such as "d7/f1234.c"
+**    --repeat N      Go over the list N times.  Default 1
+**    --nocache       Look up the working directory and the root of the
+**                    checkout again for every name, as was done before
+**                    they were cached
+*/
+void test_tree_name_benchmark_cmd(void){
+  const char *z;
+  int nGen = 0;
+  int nRepeat = 1;
+  int noCache = find_option("nocache",0,0)!=0;
+  int i, j, nName, nInside;
+  char **azName;
+  sqlite3_uint64 t0;
+  Blob name;
+
+  if( (z = find_option("generate",0,1))!=0 ) nGen = atoi(z);
+  if( (z = find_option("repeat",0,1))!=0 ) nRepeat = atoi(z);
+  verify_all_options();
+  db_must_be_within_tree();
+  nName = g.argc-2 + nGen;
+  if( nName<1 || nRepeat<1 ) usage("?OPTIONS? ?FILE ...?");
+  azName = vcs_malloc( sizeof(char*)*nName );
+  for(i=2; i<g.argc; i++) azName[i-2] = g.argv[i];
+  for(i=0; i<nGen; i++){
+    azName[g.argc-2+i] = mprintf("./d%d/../d%d/f%d.c", i%10, i%100, i);
+  }
+
+  t0 = vcs_timer_now();
+  for(j=0, nInside=0; j<nRepeat; j++){
+    for(i=0; i<nName; i++){
+      if( noCache ) file_name_cache_reset();
+      nInside += file_tree_name(azName[i], &name, 0);
+      blob_reset(&name);
     }
-    return 0;
   }
-  blob_append(pOut, &zFull[nLocalRoot], nFull-nLocalRoot);
-  blob_reset(&localRoot);
-  blob_reset(&full);
-  return 1;
+  vcs_print("%d names, %d in the tree: %10.3f ms\n",
+            nName*nRepeat, nInside, (vcs_timer_now()-t0)/1000.0);
+  for(i=0; i<nGen; i++) free(azName[g.argc-2+i]);
+  free(azName);
 }
 
 /*
@@ -834,24 +1042,73 @@ void file_tempname(int nBuf, char *zBuf){
 }
 
 
+/*
+** The size of the reads file_is_the_same() makes.
+*/
+#define FILE_CMP_CHUNK 262144
+
+/*
+** Return true if the file zName holds exactly the n bytes of z[].
+**
+** The file is read in chunks of FILE_CMP_CHUNK bytes straight into a
+** buffer, bypassing stdio buffering, and the comparison stops at the
+** first chunk that differs.  So only the start of a file that changed
+** early is ever read, and no more than one chunk is held in memory.
+*/
+static int file_same_as_buffer(const char *zName, const char *z, i64 n){
+  FILE *in;
+  char *zBuf;
+  i64 nDone = 0;
+  int same = 1;
+
+  in = vcs_fopen(zName, "rb");
+  if( in==0 ) return 0;
+  setvbuf(in, 0, _IONBF, 0);
+  zBuf = vcs_malloc(FILE_CMP_CHUNK);
+  while( nDone<n ){
+    size_t nWant = n-nDone>FILE_CMP_CHUNK ? FILE_CMP_CHUNK : (size_t)(n-nDone);
+    if( fread(zBuf, 1, nWant, in)!=nWant || memcmp(zBuf, &z[nDone], nWant) ){
+      same = 0;
+      break;
+    }
+    nDone += nWant;
+  }
+  /* The file may have grown since its size was checked */
+  if( same && fread(zBuf, 1, 1, in)!=0 ) same = 0;
+  free(zBuf);
+  fclose(in);
+  return same;
+}
+
 /*
 ** Return true if a file named zName exists and has identical content
 ** to the blob pContent.  If zName does not exist or if the content is
 ** different in any way, then return false.
 */
 int file_is_the_same(Blob *pContent, const char *zName){
-  i64 iSize;
+  FileStat st;
+  file_wd_stat(zName, &st);
+  return file_stat_is_the_same(pContent, zName, &st);
+}
+
+/*
+** Same as file_is_the_same() for a file that file_wd_stat() has already
+** filled in *pStat for.
+*/
+int file_stat_is_the_same(
+  Blob *pContent,          /* Content to compare against */
+  const char *zName,       /* Name of the file on disk */
+  const FileStat *pStat    /* What file_wd_stat() found for zName */
+){
   int rc;
   Blob onDisk;
 
-  iSize = file_wd_size(zName);
-  if( iSize<0 ) return 0;
-  if( iSize!=blob_size(pContent) ) return 0;
-  if( file_wd_islink(zName) ){
-    blob_read_link(&onDisk, zName);
-  }else{
-    blob_read_from_file(&onDisk, zName);
+  if( pStat->size<0 ) return 0;
+  if( pStat->size!=blob_size(pContent) ) return 0;
+  if( pStat->perm!=PERM_LNK ){
+    return file_same_as_buffer(zName, blob_buffer(pContent), pStat->size);
   }
+  blob_read_link(&onDisk, zName);
   rc = blob_compare(&onDisk, pContent);
   blob_reset(&onDisk);
   return rc==0;
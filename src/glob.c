@@ -63,13 +63,150 @@ char *glob_expr(const char *zVal, const char *zGlobList){
 /*
 ** A Glob object holds a set of patterns read to be matched against
 ** a string.
+**
+** The patterns are also compiled so that glob_match() does not have to
+** try them one by one.  Patterns of the forms "LITERAL", "LITERAL*"
+** and "*LITERAL" go into a single hash table keyed by the literal, and
+** a string is tested against them with one probe per distinct prefix
+** or suffix length.  Only the remaining "residual" patterns are matched
+** with strglob().
 */
 struct Glob {
   int nPattern;        /* Number of patterns */
   char **azPattern;    /* Array of pointers to patterns */
+  int nSlot;           /* Size of aSlot[].  A power of two */
+  GlobSlot *aSlot;     /* Hash table of literal patterns */
+  int nPrefixLen;      /* Number of entries in aPrefixLen[] */
+  int *aPrefixLen;     /* Distinct lengths of "LITERAL*" literals */
+  int nSuffixLen;      /* Number of entries in aSuffixLen[] */
+  int *aSuffixLen;     /* Distinct lengths of "*LITERAL" literals */
+  int nResidual;       /* Number of entries in aResidual[] */
+  int *aResidual;      /* Indexes of patterns that need strglob() */
+  int *aResidualLit;   /* Length of the literal prefix of each residual */
+};
+
+/*
+** One entry in the hash table of a Glob.
+*/
+struct GlobSlot {
+  const char *z;       /* The literal, not zero terminated.  NULL if unused */
+  int n;               /* Bytes in z */
+  int eType;           /* One of the GLOB_* values below */
+  int iPattern;        /* 1-based index of the pattern in azPattern[] */
 };
+
+/*
+** Pattern classes stored in the Glob hash table.
+*/
+#define GLOB_EXACT   1      /* LITERAL */
+#define GLOB_PREFIX  2      /* LITERAL* */
+#define GLOB_SUFFIX  3      /* *LITERAL */
 #endif /* INTERFACE */
 
+/*
+** Return true if c has a special meaning in a glob pattern.
+*/
+static int glob_is_wild(char c){
+  return c=='*' || c=='?' || c=='[';
+}
+
+/*
+** Hash a literal of class eType.
+*/
+static unsigned int glob_hash(int eType, const char *z, int n){
+  unsigned int h = 2166136261u ^ (unsigned int)eType;
+  int i;
+  for(i=0; i<n; i++){
+    h = (h ^ (unsigned char)z[i])*16777619u;
+  }
+  return h;
+}
+
+/*
+** Return the 1-based index of the pattern of class eType whose literal
+** is the n bytes at z, or 0 if there is no such pattern.
+*/
+static int glob_lookup(Glob *p, int eType, const char *z, int n){
+  unsigned int h = glob_hash(eType, z, n) & (p->nSlot-1);
+  while( p->aSlot[h].z ){
+    GlobSlot *pSlot = &p->aSlot[h];
+    if( pSlot->eType==eType && pSlot->n==n && memcmp(pSlot->z, z, n)==0 ){
+      return pSlot->iPattern;
+    }
+    h = (h+1) & (p->nSlot-1);
+  }
+  return 0;
+}
+
+/*
+** Add a literal to the hash table of p.  If the same literal is already
+** there it belongs to an earlier pattern, which takes precedence.
+*/
+static void glob_insert(Glob *p, int eType, const char *z, int n, int iPattern){
+  unsigned int h;
+  if( glob_lookup(p, eType, z, n) ) return;
+  h = glob_hash(eType, z, n) & (p->nSlot-1);
+  while( p->aSlot[h].z ) h = (h+1) & (p->nSlot-1);
+  p->aSlot[h].z = z;
+  p->aSlot[h].n = n;
+  p->aSlot[h].eType = eType;
+  p->aSlot[h].iPattern = iPattern;
+}
+
+/*
+** Add n to the set of distinct lengths in *paLen.
+*/
+static void glob_add_length(int *pnLen, int **paLen, int n){
+  int i;
+  for(i=0; i<*pnLen; i++){
+    if( (*paLen)[i]==n ) return;
+  }
+  *paLen = vcs_realloc(*paLen, (*pnLen+1)*sizeof(int));
+  (*paLen)[(*pnLen)++] = n;
+}
+
+/*
+** Sort every pattern of p into the hash table or the residual list.
+*/
+static void glob_compile(Glob *p){
+  int i;
+  p->nSlot = 8;
+  while( p->nSlot < p->nPattern*2 ) p->nSlot *= 2;
+  p->aSlot = vcs_malloc( p->nSlot*sizeof(p->aSlot[0]) );
+  memset(p->aSlot, 0, p->nSlot*sizeof(p->aSlot[0]));
+  for(i=0; i<p->nPattern; i++){
+    const char *z = p->azPattern[i];
+    int n = strlen(z);
+    int k, j;
+    for(k=0; k<n && !glob_is_wild(z[k]); k++){}
+    for(j=k; j<n && z[j]=='*'; j++){}
+    if( k==n ){
+      glob_insert(p, GLOB_EXACT, z, n, i+1);
+      continue;
+    }
+    if( j==n ){
+      glob_insert(p, GLOB_PREFIX, z, k, i+1);
+      glob_add_length(&p->nPrefixLen, &p->aPrefixLen, k);
+      continue;
+    }
+    if( k==0 ){
+      for(k=j; k<n && !glob_is_wild(z[k]); k++){}
+      if( k==n ){
+        glob_insert(p, GLOB_SUFFIX, &z[j], n-j, i+1);
+        glob_add_length(&p->nSuffixLen, &p->aSuffixLen, n-j);
+        continue;
+      }
+      k = 0;
+    }
+    p->aResidual = vcs_realloc(p->aResidual, (p->nResidual+1)*sizeof(int));
+    p->aResidualLit = vcs_realloc(p->aResidualLit,
+                                  (p->nResidual+1)*sizeof(int));
+    p->aResidual[p->nResidual] = i;
+    p->aResidualLit[p->nResidual] = k;
+    p->nResidual++;
+  }
+}
+
 /*
 ** zPatternList is a comma-separate list of glob patterns.  Parse up
 ** that list and use it to create a new Glob object.
@@ -118,6 +255,7 @@ Glob *glob_create(const char *zPatternList){
     z[i] = 0;
     z += i+1;
   }
+  glob_compile(p);
   return p;
 }
 
@@ -208,12 +346,31 @@ int strglob(const char *zGlob, const char *z){
 ** A NULL glob matches nothing.
 */
 int glob_match(Glob *pGlob, const char *zString){
-  int i;
+  int i, n, x;
+  int best;           /* Lowest matching pattern index seen so far */
   if( pGlob==0 ) return 0;
-  for(i=0; i<pGlob->nPattern; i++){
-    if( strglob(pGlob->azPattern[i], zString) ) return i+1;
+  n = strlen(zString);
+  best = glob_lookup(pGlob, GLOB_EXACT, zString, n);
+  for(i=0; i<pGlob->nPrefixLen; i++){
+    int nLit = pGlob->aPrefixLen[i];
+    if( nLit>n ) continue;
+    x = glob_lookup(pGlob, GLOB_PREFIX, zString, nLit);
+    if( x && (best==0 || x<best) ) best = x;
   }
-  return 0;
+  for(i=0; i<pGlob->nSuffixLen; i++){
+    int nLit = pGlob->aSuffixLen[i];
+    if( nLit>n ) continue;
+    x = glob_lookup(pGlob, GLOB_SUFFIX, &zString[n-nLit], nLit);
+    if( x && (best==0 || x<best) ) best = x;
+  }
+  for(i=0; i<pGlob->nResidual; i++){
+    int k = pGlob->aResidual[i];
+    const char *zPattern = pGlob->azPattern[k];
+    if( best && k+1>=best ) break;
+    if( strncmp(zPattern, zString, pGlob->aResidualLit[i])!=0 ) continue;
+    if( strglob(zPattern, zString) ) return k+1;
+  }
+  return best;
 }
 
 /*
@@ -222,6 +379,41 @@ int glob_match(Glob *pGlob, const char *zString){
 void glob_free(Glob *pGlob){
   if( pGlob ){
     vcs_free(pGlob->azPattern);
+    vcs_free(pGlob->aSlot);
+    vcs_free(pGlob->aPrefixLen);
+    vcs_free(pGlob->aSuffixLen);
+    vcs_free(pGlob->aResidual);
+    vcs_free(pGlob->aResidualLit);
     vcs_free(pGlob);
   }
 }
+
+/*
+** COMMAND: test-glob
+**
+** Usage:  %vcs test-glob PATTERNS STRING...
+**
+** PATTERNS is a comma-separated list of glob patterns.  Show which
+** pattern, if any, matches each STRING.  Each result is checked
+** against trying the patterns one by one with strglob().
+*/
+void glob_test_cmd(void){
+  Glob *pGlob;
+  int i, j;
+  if( g.argc<4 ) usage("PATTERNS STRING...");
+  pGlob = glob_create(g.argv[2]);
+  for(i=3; i<g.argc; i++){
+    int x = glob_match(pGlob, g.argv[i]);
+    int y = 0;
+    for(j=0; pGlob && j<pGlob->nPattern && y==0; j++){
+      if( strglob(pGlob->azPattern[j], g.argv[i]) ) y = j+1;
+    }
+    if( x ){
+      vcs_print("%d: %s  (%s)\n", x, g.argv[i], pGlob->azPattern[x-1]);
+    }else{
+      vcs_print("0: %s\n", g.argv[i]);
+    }
+    if( x!=y ) vcs_print("  MISMATCH: sequential match is %d\n", y);
+  }
+  glob_free(pGlob);
+}
@@ -7,7 +7,18 @@
 
 #if INTERFACE
 
-#define GR_MAX_RAIL   32      /* Max number of "rails" to display */
+#define GR_MAX_RAIL   1000    /* Max number of "rails" to display */
+
+/* A rail-specific annotation on a single GraphRow.  A row typically
+** touches only a few rails, so each row keeps a short array of these
+** rather than one slot for every possible rail.
+*/
+struct GraphRail {
+  int iRail;                  /* The rail this entry describes */
+  int iRiser;                 /* Riser up to this row index.  -1 for none */
+  u8 mergeIn;                 /* Merge in from this rail.  0 for none */
+  u8 mergeDown;               /* True to draw merge line up from bottom */
+};
 
 /* The graph appears vertically beside a timeline.  Each row in the
 ** timeline corresponds to a row in the graph.  GraphRow.idx is 0 for
@@ -31,14 +42,40 @@ struct GraphRow {
   u8 isLeaf;                  /* True if this is a leaf node */
   u8 timeWarp;                /* Child is earlier in time */
   u8 bDescender;              /* True if riser from bottom of graph to here. */
-  i8 iRail;                   /* Which rail this check-in appears on. 0-based.*/
-  i8 mergeOut;                /* Merge out to this rail.  -1 if no merge-out */
-  u8 mergeIn[GR_MAX_RAIL];    /* Merge in from non-zero rails */
-  int aiRiser[GR_MAX_RAIL];   /* Risers from this node to a higher row. */
+  int iRail;                  /* Which rail this check-in appears on. 0-based.*/
+  int mergeOut;               /* Merge out to this rail.  -1 if no merge-out */
   int mergeUpto;              /* Draw the mergeOut rail up to this level */
-  u32 mergeDown;              /* Draw merge lines up from bottom of graph */
+  int nRail;                  /* Number of entries in aRail[] */
+  int nRailAlloc;             /* Slots allocated for aRail[] */
+  GraphRail *aRail;           /* Risers and merge lines, by rail */
+};
+
+/* A range of rows, inclusive, occupied by some rail.
+*/
+struct GraphSpan {
+  int top;                   /* Index of the top-most row */
+  int btm;                   /* Index of the bottom-most row */
+};
 
-  u32 railInUse;              /* Mask of occupied rails at this row */
+/* Occupancy of a single rail.  aSpan[] is sorted by row index and the
+** spans in it neither overlap nor touch.
+*/
+struct GraphRailUse {
+  int nSpan;                 /* Number of entries in aSpan[] */
+  int nAlloc;                /* Slots allocated for aSpan[] */
+  GraphSpan *aSpan;          /* Rows on which this rail is in use */
+  u8 isOpen;                 /* Rail carries a branch that continues upward */
+};
+
+/* A block of memory from which GraphRow objects, their parent arrays,
+** their rail arrays, and branch names are carved.  All blocks are
+** released together by graph_free().
+*/
+struct GraphChunk {
+  GraphChunk *pNext;         /* Next older chunk */
+  int nUsed;                 /* Bytes of aData[] handed out so far */
+  int nAlloc;                /* Bytes available in aData[] */
+  char *aData;               /* The memory, immediately following this */
 };
 
 /* Context while building a graph
@@ -49,10 +86,14 @@ struct GraphContext {
   GraphRow *pFirst;          /* First row in the list */
   GraphRow *pLast;           /* Last row in the list */
   int nBranch;               /* Number of distinct branches */
-  char **azBranch;           /* Names of the branches */
+  int nBranchHash;           /* Number of slots in azBranchHash[] */
+  char **azBranchHash;       /* Hash table of branch names.  Key: the name */
   int nRow;                  /* Number of rows */
   int nHash;                 /* Number of slots in apHash[] */
   GraphRow **apHash;         /* Hash table of GraphRow objects.  Key: rid */
+  GraphChunk *pChunk;        /* Memory from which rows are allocated */
+  int nRailUse;              /* Number of entries in aRailUse[] */
+  GraphRailUse *aRailUse;    /* Occupancy of each rail */
 };
 
 #endif
@@ -74,20 +115,49 @@ GraphContext *graph_init(void){
   return (GraphContext*)safeMalloc( sizeof(GraphContext) );
 }
 
+/*
+** Size of each GraphChunk allocation, not counting the header.
+*/
+#define GRAPH_CHUNK_SIZE  65536
+
+/*
+** Return nByte bytes of zeroed space out of the arena owned by p.
+** The space is 8-byte aligned and lasts until the graph is cleared.
+*/
+static void *graphAlloc(GraphContext *p, int nByte){
+  GraphChunk *pChunk = p->pChunk;
+  void *pRes;
+  nByte = (nByte+7)&~7;
+  if( pChunk==0 || pChunk->nUsed+nByte>pChunk->nAlloc ){
+    int nAlloc = nByte>GRAPH_CHUNK_SIZE ? nByte : GRAPH_CHUNK_SIZE;
+    int nHdr = (sizeof(GraphChunk)+7)&~7;
+    pChunk = vcs_malloc( nHdr + nAlloc );
+    pChunk->aData = ((char*)pChunk) + nHdr;
+    pChunk->nUsed = 0;
+    pChunk->nAlloc = nAlloc;
+    pChunk->pNext = p->pChunk;
+    p->pChunk = pChunk;
+  }
+  pRes = &pChunk->aData[pChunk->nUsed];
+  pChunk->nUsed += nByte;
+  memset(pRes, 0, nByte);
+  return pRes;
+}
+
 /*
 ** Clear all content from a graph
 */
 static void graph_clear(GraphContext *p){
   int i;
-  GraphRow *pRow;
-  while( p->pFirst ){
-    pRow = p->pFirst;
-    p->pFirst = pRow->pNext;
-    free(pRow);
+  while( p->pChunk ){
+    GraphChunk *pChunk = p->pChunk;
+    p->pChunk = pChunk->pNext;
+    free(pChunk);
   }
-  for(i=0; i<p->nBranch; i++) free(p->azBranch[i]);
-  free(p->azBranch);
+  free(p->azBranchHash);
   free(p->apHash);
+  for(i=0; i<p->nRailUse; i++) free(p->aRailUse[i].aSpan);
+  free(p->aRailUse);
   memset(p, 0, sizeof(*p));
   p->nErr = 1;
 }
@@ -100,17 +170,23 @@ void graph_free(GraphContext *p){
   free(p);
 }
 
+/*
+** The hash function for rids.  The table size is always a power of
+** two, so mix the bits so that runs of consecutive rids spread out.
+*/
+#define graph_rid_hash(RID)  (((unsigned)(RID))*2654435761u)
+
 /*
 ** Insert a row into the hash table.  pRow->rid is the key.  Keys must
 ** be unique.  If there is already another row with the same rid,
 ** overwrite the prior entry if and only if the overwrite flag is set.
 */
 static void hashInsert(GraphContext *p, GraphRow *pRow, int overwrite){
-  int h;
-  h = pRow->rid % p->nHash;
+  unsigned h;
+  unsigned mask = p->nHash - 1;
+  h = graph_rid_hash(pRow->rid) & mask;
   while( p->apHash[h] && p->apHash[h]->rid!=pRow->rid ){
-    h++;
-    if( h>=p->nHash ) h = 0;
+    h = (h+1) & mask;
   }
   if( p->apHash[h]==0 || overwrite ){
     p->apHash[h] = pRow;
@@ -121,14 +197,33 @@ static void hashInsert(GraphContext *p, GraphRow *pRow, int overwrite){
 ** Look up the row with rid.
 */
 static GraphRow *hashFind(GraphContext *p, int rid){
-  int h = rid % p->nHash;
+  unsigned h;
+  unsigned mask = p->nHash - 1;
+  if( p->nHash==0 ) return 0;
+  h = graph_rid_hash(rid) & mask;
   while( p->apHash[h] && p->apHash[h]->rid!=rid ){
-    h++;
-    if( h>=p->nHash ) h = 0;
+    h = (h+1) & mask;
   }
   return p->apHash[h];
 }
 
+/*
+** Grow the rid hash table so that it can hold at least one more row
+** while staying no more than half full.
+*/
+static void hashGrow(GraphContext *p){
+  GraphRow **apOld = p->apHash;
+  int nOld = p->nHash;
+  int i;
+  if( (p->nRow+1)*2 <= p->nHash ) return;
+  p->nHash = nOld ? nOld*2 : 64;
+  p->apHash = safeMalloc( sizeof(p->apHash[0])*p->nHash );
+  for(i=0; i<nOld; i++){
+    if( apOld[i] ) hashInsert(p, apOld[i], 0);
+  }
+  free(apOld);
+}
+
 /*
 ** Return the canonical pointer for a given branch name.
 ** Multiple calls to this routine with equivalent strings
@@ -141,14 +236,38 @@ static GraphRow *hashFind(GraphContext *p, int rid){
 ** Note: also used for background color names.
 */
 static char *persistBranchName(GraphContext *p, const char *zBranch){
-  int i;
-  for(i=0; i<p->nBranch; i++){
-    if( vcs_strcmp(zBranch, p->azBranch[i])==0 ) return p->azBranch[i];
+  unsigned h = 0;
+  unsigned mask;
+  int i, n;
+  char *z;
+
+  if( (p->nBranch+1)*2 > p->nBranchHash ){
+    char **azOld = p->azBranchHash;
+    int nOld = p->nBranchHash;
+    p->nBranchHash = nOld ? nOld*2 : 64;
+    p->azBranchHash = safeMalloc( sizeof(char*)*p->nBranchHash );
+    mask = p->nBranchHash - 1;
+    for(i=0; i<nOld; i++){
+      if( azOld[i]==0 ) continue;
+      for(h=0, z=azOld[i]; *z; z++) h = (h<<3) ^ h ^ (unsigned char)*z;
+      h &= mask;
+      while( p->azBranchHash[h] ) h = (h+1) & mask;
+      p->azBranchHash[h] = azOld[i];
+    }
+    free(azOld);
+  }
+  mask = p->nBranchHash - 1;
+  for(h=0, n=0; zBranch[n]; n++) h = (h<<3) ^ h ^ (unsigned char)zBranch[n];
+  h &= mask;
+  while( (z = p->azBranchHash[h])!=0 ){
+    if( vcs_strcmp(zBranch, z)==0 ) return z;
+    h = (h+1) & mask;
   }
+  z = graphAlloc(p, n+1);
+  memcpy(z, zBranch, n+1);
+  p->azBranchHash[h] = z;
   p->nBranch++;
-  p->azBranch = vcs_realloc(p->azBranch, sizeof(char*)*p->nBranch);
-  p->azBranch[p->nBranch-1] = mprintf("%s", zBranch);
-  return p->azBranch[p->nBranch-1];
+  return z;
 }
 
 /*
@@ -164,18 +283,18 @@ int graph_add_row(
   int isLeaf           /* True if this row is a leaf */
 ){
   GraphRow *pRow;
+  GraphRow *pDup;
   int nByte;
 
   if( p->nErr ) return 0;
   nByte = sizeof(GraphRow);
   nByte += sizeof(pRow->aParent[0])*nParent;
-  pRow = (GraphRow*)safeMalloc( nByte );
+  pRow = (GraphRow*)graphAlloc(p, nByte);
   pRow->aParent = (int*)&pRow[1];
   pRow->rid = rid;
   pRow->nParent = nParent;
   pRow->zBranch = persistBranchName(p, zBranch);
   pRow->isLeaf = isLeaf;
-  memset(pRow->aiRiser, -1, sizeof(pRow->aiRiser));
   if( zBgClr==0 || zBgClr[0]==0 ) zBgClr = "white";
   pRow->zBgClr = persistBranchName(p, zBgClr);
   memcpy(pRow->aParent, aParent, sizeof(aParent[0])*nParent);
@@ -183,47 +302,193 @@ int graph_add_row(
     p->pFirst = pRow;
   }else{
     p->pLast->pNext = pRow;
+    pRow->pPrev = p->pLast;
   }
   p->pLast = pRow;
+  hashGrow(p);
+  if( (pDup = hashFind(p, rid))!=0 ) pDup->isDup = 1;
+  hashInsert(p, pRow, 1);
   p->nRow++;
   pRow->idx = pRow->idxTop = p->nRow;
   return pRow->idx;
 }
 
+/*
+** Return the entry for rail iRail on row pRow.  If there is no such
+** entry, create one if createFlag is true, or return NULL otherwise.
+*/
+static GraphRail *rowRail(
+  GraphContext *p,         /* Arena for new entries.  NULL if !createFlag */
+  GraphRow *pRow,          /* The row */
+  int iRail,               /* The rail */
+  int createFlag           /* Create the entry if it does not exist */
+){
+  GraphRail *pRail;
+  int i;
+  for(i=0; i<pRow->nRail; i++){
+    if( pRow->aRail[i].iRail==iRail ) return &pRow->aRail[i];
+  }
+  if( !createFlag ) return 0;
+  if( pRow->nRail>=pRow->nRailAlloc ){
+    GraphRail *aNew;
+    pRow->nRailAlloc = pRow->nRailAlloc*2 + 2;
+    aNew = graphAlloc(p, sizeof(pRow->aRail[0])*pRow->nRailAlloc);
+    if( pRow->nRail ){
+      memcpy(aNew, pRow->aRail, sizeof(pRow->aRail[0])*pRow->nRail);
+    }
+    pRow->aRail = aNew;
+  }
+  pRail = &pRow->aRail[pRow->nRail++];
+  memset(pRail, 0, sizeof(*pRail));
+  pRail->iRail = iRail;
+  pRail->iRiser = -1;
+  return pRail;
+}
+
+/*
+** Return the row index to which a riser on rail iRail ascends from
+** pRow, or -1 if there is no such riser.
+*/
+int graph_row_riser(GraphRow *pRow, int iRail){
+  GraphRail *pRail = rowRail(0, pRow, iRail, 0);
+  return pRail ? pRail->iRiser : -1;
+}
+
+/*
+** Return the merge-in code for rail iRail on pRow.  Zero means that
+** nothing merges into pRow from that rail.
+*/
+int graph_row_merge_in(GraphRow *pRow, int iRail){
+  GraphRail *pRail = rowRail(0, pRow, iRail, 0);
+  return pRail ? pRail->mergeIn : 0;
+}
+
+/*
+** Return true if a merge line is drawn up from the bottom of the
+** graph to pRow on rail iRail.
+*/
+int graph_row_merge_down(GraphRow *pRow, int iRail){
+  GraphRail *pRail = rowRail(0, pRow, iRail, 0);
+  return pRail ? pRail->mergeDown : 0;
+}
+
+/*
+** Make sure p->aRailUse[] has an entry for rail iRail.
+*/
+static GraphRailUse *railUse(GraphContext *p, int iRail){
+  assert( iRail>=0 );
+  if( iRail>=p->nRailUse ){
+    int nNew = iRail*2 + 8;
+    p->aRailUse = vcs_realloc(p->aRailUse, sizeof(p->aRailUse[0])*nNew);
+    memset(&p->aRailUse[p->nRailUse], 0,
+           sizeof(p->aRailUse[0])*(nNew - p->nRailUse));
+    p->nRailUse = nNew;
+  }
+  return &p->aRailUse[iRail];
+}
+
+/*
+** Return the index of the first span in pUse that ends at or below
+** row iRow, or pUse->nSpan if there is no such span.
+*/
+static int railSpanSearch(GraphRailUse *pUse, int iRow){
+  int lwr = 0;
+  int upr = pUse->nSpan;
+  while( lwr<upr ){
+    int mid = (lwr+upr)/2;
+    if( pUse->aSpan[mid].btm<iRow ){
+      lwr = mid + 1;
+    }else{
+      upr = mid;
+    }
+  }
+  return lwr;
+}
+
+/*
+** Record that rail iRail is in use for every row from top through btm,
+** inclusive.
+*/
+static void railMark(GraphContext *p, int iRail, int top, int btm){
+  GraphRailUse *pUse;
+  int i, j;
+  if( top>btm ) return;
+  pUse = railUse(p, iRail);
+  i = railSpanSearch(pUse, top-1);
+  for(j=i; j<pUse->nSpan && pUse->aSpan[j].top<=btm+1; j++){
+    if( pUse->aSpan[j].top<top ) top = pUse->aSpan[j].top;
+    if( pUse->aSpan[j].btm>btm ) btm = pUse->aSpan[j].btm;
+  }
+  if( i==j ){
+    /* No span is overlapped or adjacent.  Insert a new one at i. */
+    if( pUse->nSpan>=pUse->nAlloc ){
+      pUse->nAlloc = pUse->nAlloc*2 + 4;
+      pUse->aSpan = vcs_realloc(pUse->aSpan,
+                                sizeof(pUse->aSpan[0])*pUse->nAlloc);
+    }
+    memmove(&pUse->aSpan[i+1], &pUse->aSpan[i],
+            sizeof(pUse->aSpan[0])*(pUse->nSpan - i));
+    pUse->nSpan++;
+  }else if( j>i+1 ){
+    /* Spans i through j-1 all collapse into span i */
+    memmove(&pUse->aSpan[i+1], &pUse->aSpan[j],
+            sizeof(pUse->aSpan[0])*(pUse->nSpan - j));
+    pUse->nSpan -= j - i - 1;
+  }
+  pUse->aSpan[i].top = top;
+  pUse->aSpan[i].btm = btm;
+}
+
+/*
+** Return true if rail iRail is in use on any row between top and btm,
+** inclusive.
+*/
+static int railBusy(GraphContext *p, int iRail, int top, int btm){
+  GraphRailUse *pUse;
+  int i;
+  if( iRail>=p->nRailUse ) return 0;
+  pUse = &p->aRailUse[iRail];
+  i = railSpanSearch(pUse, top);
+  return i<pUse->nSpan && pUse->aSpan[i].top<=btm;
+}
+
 /*
 ** Return the index of a rail currently not in use for any row between
-** top and bottom, inclusive.  
+** top and bottom, inclusive.  If checkOpen is true, rails that are
+** still carrying an open branch upward are also avoided.
+**
+** Every rail at or beyond p->nRailUse is unused, so the search is
+** bounded by the number of rails that have ever been touched rather
+** than by any fixed limit.
 */
 static int findFreeRail(
   GraphContext *p,         /* The graph context */
   int top, int btm,        /* Span of rows for which the rail is needed */
-  u32 inUseMask,           /* Mask or rails already in use */
+  int checkOpen,           /* Also avoid rails marked as open */
   int iNearto              /* Find rail nearest to this rail */
 ){
-  GraphRow *pRow;
   int i;
-  int iBest = 0;
-  int iBestDist = 9999;
-  for(pRow=p->pFirst; pRow && pRow->idx<top; pRow=pRow->pNext){}
-  while( pRow && pRow->idx<=btm ){
-    inUseMask |= pRow->railInUse;
-    pRow = pRow->pNext;
-  }
-  for(i=0; i<32; i++){
-    if( (inUseMask & (1<<i))==0 ){
-      int dist;
-      if( iNearto<=0 ){
-        return i;
-      }
-      dist = i - iNearto;
-      if( dist<0 ) dist = -dist;
-      if( dist<iBestDist ){
-        iBestDist = dist;
-        iBest = i;
-      }
+  int iBest = -1;
+  int iBestDist = 0;
+  for(i=0; i<=p->nRailUse; i++){
+    int dist;
+    if( i<p->nRailUse ){
+      if( checkOpen && p->aRailUse[i].isOpen ) continue;
+      if( railBusy(p, i, top, btm) ) continue;
+    }
+    if( iNearto<=0 ){
+      iBest = i;
+      break;
+    }
+    dist = i - iNearto;
+    if( dist<0 ) dist = -dist;
+    if( iBest<0 || dist<iBestDist ){
+      iBestDist = dist;
+      iBest = i;
+    }else if( i>iNearto ){
+      break;    /* Distance only grows from here on */
     }
   }
-  if( iBestDist>1000 ) p->nErr++;
   if( iBest>p->mxRail ) p->mxRail = iBest;
   return iBest;
 }
@@ -231,27 +496,22 @@ static int findFreeRail(
 /*
 ** Assign all children of node pBottom to the same rail as pBottom.
 */
-static void assignChildrenToRail(GraphRow *pBottom){
+static void assignChildrenToRail(GraphContext *p, GraphRow *pBottom){
   int iRail = pBottom->iRail;
   GraphRow *pCurrent;
   GraphRow *pPrior;
-  u32 mask = 1<<iRail;
+  int top = pBottom->idx;
 
-  pBottom->iRail = iRail;
-  pBottom->railInUse |= mask;
   pPrior = pBottom;
   for(pCurrent=pBottom->pChild; pCurrent; pCurrent=pCurrent->pChild){
     assert( pPrior->idx > pCurrent->idx );
     assert( pCurrent->iRail<0 );
     pCurrent->iRail = iRail;
-    pCurrent->railInUse |= mask;
-    pPrior->aiRiser[iRail] = pCurrent->idx;
-    while( pPrior->idx > pCurrent->idx ){
-      pPrior->railInUse |= mask;
-      pPrior = pPrior->pPrev;
-      assert( pPrior!=0 );
-    }
+    rowRail(p, pPrior, iRail, 1)->iRiser = pCurrent->idx;
+    top = pCurrent->idx;
+    pPrior = pCurrent;
   }
+  railMark(p, iRail, top, pBottom->idx);
 }
 
 /*
@@ -263,11 +523,10 @@ static void createMergeRiser(
   GraphRow *pChild
 ){
   int u;
-  u32 mask;
-  GraphRow *pLoop;
+  GraphRail *pRail;
 
   if( pParent->mergeOut<0 ){
-    u = pParent->aiRiser[pParent->iRail];
+    u = graph_row_riser(pParent, pParent->iRail);
     if( u>=0 && u<pChild->idx ){
       /* The thick arrow up to the next primary child of pDesc goes
       ** further up than the thin merge arrow riser, so draw them both
@@ -282,14 +541,11 @@ static void createMergeRiser(
       pParent->mergeOut = findFreeRail(p, pChild->idx, pParent->idx-1,
                                        0, iTarget)*4 + 1;
       pParent->mergeUpto = pChild->idx;
-      mask = 1<<(pParent->mergeOut/4);
-      for(pLoop=pChild->pNext; pLoop && pLoop->rid!=pParent->rid;
-           pLoop=pLoop->pNext){
-        pLoop->railInUse |= mask;
-      }
+      railMark(p, pParent->mergeOut/4, pChild->idx+1, pParent->idx-1);
     }
   }
-  pChild->mergeIn[pParent->mergeOut/4] = (pParent->mergeOut&3)+1;
+  pRail = rowRail(p, pChild, pParent->mergeOut/4, 1);
+  pRail->mergeIn = (pParent->mergeOut&3)+1;
 }
 
 /*
@@ -297,12 +553,16 @@ static void createMergeRiser(
 */
 static void find_max_rail(GraphContext *p){
   GraphRow *pRow;
+  int i;
   p->mxRail = 0;
   for(pRow=p->pFirst; pRow; pRow=pRow->pNext){
     if( pRow->iRail>p->mxRail ) p->mxRail = pRow->iRail;
     if( pRow->mergeOut/4>p->mxRail ) p->mxRail = pRow->mergeOut/4;
-    while( p->mxRail<GR_MAX_RAIL && pRow->mergeDown>((1<<(p->mxRail+1))-1) ){
-      p->mxRail++;
+    for(i=0; i<pRow->nRail; i++){
+      GraphRail *pRail = &pRow->aRail[i];
+      if( pRail->mergeDown && pRail->iRail>p->mxRail ){
+        p->mxRail = pRail->iRail;
+      }
     }
   }
 }
@@ -312,28 +572,20 @@ static void find_max_rail(GraphContext *p){
 ** Compute the complete graph
 */
 void graph_finish(GraphContext *p, int omitDescenders){
-  GraphRow *pRow, *pDesc, *pDup, *pLoop, *pParent;
+  GraphRow *pRow, *pDesc, *pParent;
   int i;
-  u32 mask;
-  u32 inUse;
   int hasDup = 0;      /* True if one or more isDup entries */
   const char *zTrunk;
 
   if( p==0 || p->pFirst==0 || p->nErr ) return;
   p->nErr = 1;   /* Assume an error until proven otherwise */
 
-  /* Initialize all rows */
-  p->nHash = p->nRow*2 + 1;
-  p->apHash = safeMalloc( sizeof(p->apHash[0])*p->nHash );
+  /* Initialize all rows.  The rid hash table and the isDup flags
+  ** were already filled in by graph_add_row(). */
   for(pRow=p->pFirst; pRow; pRow=pRow->pNext){
-    if( pRow->pNext ) pRow->pNext->pPrev = pRow;
     pRow->iRail = -1;
     pRow->mergeOut = -1;
-    if( (pDup = hashFind(p, pRow->rid))!=0 ){
-      hasDup = 1;
-      pDup->isDup = 1;
-    }
-    hashInsert(p, pRow, 1);
+    if( pRow->isDup ) hasDup = 1;
   }
   p->mxRail = -1;
 
@@ -398,34 +650,28 @@ void graph_finish(GraphContext *p, int omitDescenders){
           pRow->iRail = ++p->mxRail;
         }
         if( p->mxRail>=GR_MAX_RAIL ) return;
-        mask = 1<<(pRow->iRail);
         if( !omitDescenders ){
           pRow->bDescender = pRow->nParent>0;
-          for(pLoop=pRow; pLoop; pLoop=pLoop->pNext){
-            pLoop->railInUse |= mask;
-          }
+          railMark(p, pRow->iRail, pRow->idx, p->nRow);
         }
-        assignChildrenToRail(pRow);
+        assignChildrenToRail(p, pRow);
       }
     }
   }
 
   /* Assign rails to all rows that are still unassigned.
   */
-  inUse = (1<<(p->mxRail+1))-1;
+  for(i=0; i<=p->mxRail; i++) railUse(p, i)->isOpen = 1;
   for(pRow=p->pLast; pRow; pRow=pRow->pPrev){
     int parentRid;
 
     if( pRow->iRail>=0 ){
       if( pRow->pChild==0 && !pRow->timeWarp ){
         if( omitDescenders || count_nonbranch_children(pRow->rid)==0 ){
-          inUse &= ~(1<<pRow->iRail);
+          railUse(p, pRow->iRail)->isOpen = 0;
         }else{
-          pRow->aiRiser[pRow->iRail] = 0;
-          mask = 1<<pRow->iRail;
-          for(pLoop=pRow; pLoop; pLoop=pLoop->pPrev){
-            pLoop->railInUse |= mask;
-          }
+          rowRail(p, pRow, pRow->iRail, 1)->iRiser = 0;
+          railMark(p, pRow->iRail, 1, pRow->idx);
         }
       }
       continue;
@@ -439,15 +685,15 @@ void graph_finish(GraphContext *p, int omitDescenders){
       if( pParent==0 ){
         pRow->iRail = ++p->mxRail;
         if( p->mxRail>=GR_MAX_RAIL ) return;
-        pRow->railInUse = 1<<pRow->iRail;
+        railMark(p, pRow->iRail, pRow->idx, pRow->idx);
         continue;
       }
       if( pParent->idx>pRow->idx ){
         /* Common case:  Child occurs after parent and is above the
         ** parent in the timeline */
-        pRow->iRail = findFreeRail(p, 0, pParent->idx, inUse, pParent->iRail);
+        pRow->iRail = findFreeRail(p, 0, pParent->idx, 1, pParent->iRail);
         if( p->mxRail>=GR_MAX_RAIL ) return;
-        pParent->aiRiser[pRow->iRail] = pRow->idx;
+        rowRail(p, pParent, pRow->iRail, 1)->iRiser = pRow->idx;
       }else{
         /* Timewarp case:  Child occurs earlier in time than parent and
         ** appears below the parent in the timeline. */
@@ -455,26 +701,24 @@ void graph_finish(GraphContext *p, int omitDescenders){
         if( iDownRail<1 ) iDownRail = ++p->mxRail;
         pRow->iRail = ++p->mxRail;
         if( p->mxRail>=GR_MAX_RAIL ) return;
-        pRow->railInUse = 1<<pRow->iRail;
-        pParent->aiRiser[iDownRail] = pRow->idx;
-        mask = 1<<iDownRail;
-        inUse |= mask;
-        for(pLoop=p->pFirst; pLoop; pLoop=pLoop->pNext){
-          pLoop->railInUse |= mask;
-        }
+        railMark(p, pRow->iRail, pRow->idx, pRow->idx);
+        rowRail(p, pParent, iDownRail, 1)->iRiser = pRow->idx;
+        railUse(p, iDownRail)->isOpen = 1;
+        railMark(p, iDownRail, 1, p->nRow);
       }
     }
-    mask = 1<<pRow->iRail;
-    pRow->railInUse |= mask;
+    railMark(p, pRow->iRail, pRow->idx, pRow->idx);
     if( pRow->pChild==0 ){
-      inUse &= ~mask;
+      railUse(p, pRow->iRail)->isOpen = 0;
     }else{
-      inUse |= mask;
-      assignChildrenToRail(pRow);
+      railUse(p, pRow->iRail)->isOpen = 1;
+      assignChildrenToRail(p, pRow);
     }
     if( pParent ){
-      for(pLoop=pParent->pPrev; pLoop && pLoop!=pRow; pLoop=pLoop->pPrev){
-        pLoop->railInUse |= mask;
+      if( pParent->idx>pRow->idx ){
+        railMark(p, pRow->iRail, pRow->idx+1, pParent->idx-1);
+      }else{
+        railMark(p, pRow->iRail, 1, pParent->idx-1);
       }
     }
   }
@@ -489,13 +733,12 @@ void graph_finish(GraphContext *p, int omitDescenders){
       if( pDesc==0 ){
         /* Merge from a node that is off-screen */
         int iMrail = findFreeRail(p, pRow->idx, p->nRow, 0, 0);
+        GraphRail *pRail;
         if( p->mxRail>=GR_MAX_RAIL ) return;
-        mask = 1<<iMrail;
-        pRow->mergeIn[iMrail] = 2;
-        pRow->mergeDown |= mask;
-        for(pLoop=pRow->pNext; pLoop; pLoop=pLoop->pNext){
-          pLoop->railInUse |= mask;
-        }
+        pRail = rowRail(p, pRow, iMrail, 1);
+        pRail->mergeIn = 2;
+        pRail->mergeDown = 1;
+        railMark(p, iMrail, pRow->idx+1, p->nRow);
       }else{
         /* Merge from an on-screen node */
         createMergeRiser(p, pDesc, pRow);
@@ -537,3 +780,71 @@ void graph_finish(GraphContext *p, int omitDescenders){
   find_max_rail(p);
   p->nErr = 0;
 }
+
+/*
+** COMMAND: test-graph-layout
+**
+** Usage: %vcs test-graph-layout ?OPTIONS?
+**
+** Build a synthetic timeline and time how long it takes to add the
+** rows to a GraphContext and to compute the graph layout.  No
+** repository is needed.  Options:
+**
+**    --rows N          Number of check-ins in the timeline.  Default 50000
+**    --branches N      Number of concurrent branches.  Default 100
+**    --merge N         Every Nth check-in merges from another branch.
+**                      Default 10.  Use 0 for no merges.
+**    --repeat N        Repeat the whole layout N times.  Default 1
+*/
+void test_graph_layout_cmd(void){
+  const char *z;
+  int nRow = 50000;
+  int nBranch = 100;
+  int nMerge = 10;
+  int nRepeat = 1;
+  int i, iRep;
+  int aParent[2];
+  char **azBranch;
+  sqlite3_uint64 tAdd = 0, tFinish = 0, t0;
+  GraphContext *pGraph = 0;
+
+  if( (z = find_option("rows",0,1))!=0 ) nRow = atoi(z);
+  if( (z = find_option("branches",0,1))!=0 ) nBranch = atoi(z);
+  if( (z = find_option("merge",0,1))!=0 ) nMerge = atoi(z);
+  if( (z = find_option("repeat",0,1))!=0 ) nRepeat = atoi(z);
+  verify_all_options();
+  if( nRow<1 || nBranch<1 || nRepeat<1 ) usage("?OPTIONS?");
+  azBranch = vcs_malloc( sizeof(char*)*nBranch );
+  azBranch[0] = mprintf("trunk");
+  for(i=1; i<nBranch; i++) azBranch[i] = mprintf("branch-%d", i);
+
+  for(iRep=0; iRep<nRepeat; iRep++){
+    t0 = vcs_timer_now();
+    pGraph = graph_init();
+    /* Rows are added newest first.  Row i is on branch i%nBranch and its
+    ** primary parent is the next row down on the same branch. */
+    for(i=0; i<nRow; i++){
+      int rid = nRow - i;
+      int nParent = 0;
+      if( i+nBranch<nRow ) aParent[nParent++] = rid - nBranch;
+      if( nMerge>0 && i%nMerge==0 && nParent && i+nBranch+1<nRow ){
+        aParent[nParent++] = rid - nBranch - 1;
+      }
+      graph_add_row(pGraph, rid, nParent, aParent, azBranch[i%nBranch],
+                    0, i<nBranch);
+    }
+    tAdd += vcs_timer_now() - t0;
+    t0 = vcs_timer_now();
+    graph_finish(pGraph, 1);
+    tFinish += vcs_timer_now() - t0;
+    if( iRep<nRepeat-1 ) graph_free(pGraph);
+  }
+  vcs_print("rows:        %d\n", nRow);
+  vcs_print("names:       %d\n", pGraph->nBranch);
+  vcs_print("rails:       %d\n", pGraph->nErr ? -1 : pGraph->mxRail+1);
+  vcs_print("add rows:    %.3f ms\n", tAdd/1000.0/nRepeat);
+  vcs_print("layout:      %.3f ms\n", tFinish/1000.0/nRepeat);
+  graph_free(pGraph);
+  for(i=0; i<nBranch; i++) free(azBranch[i]);
+  free(azBranch);
+}
@@ -16,17 +16,7 @@
 ** A leaf has no children in the same branch. 
 */
 int is_a_leaf(int rid){
-  int rc;
-  static const char zSql[] = 
-    @ SELECT 1 FROM plink
-    @  WHERE pid=%d
-    @    AND coalesce((SELECT value FROM tagxref
-    @                   WHERE tagid=%d AND rid=plink.pid), 'trunk')
-    @       =coalesce((SELECT value FROM tagxref
-    @                   WHERE tagid=%d AND rid=plink.cid), 'trunk')
-  ;
-  rc = db_int(0, zSql, rid, TAG_BRANCH, TAG_BRANCH);
-  return rc==0;
+  return dag_is_leaf(dag_index(), rid);
 }
 
 /*
@@ -39,23 +29,7 @@ int is_a_leaf(int rid){
 ** A non-branch child is one which is on the same branch as the parent.
 */
 int count_nonbranch_children(int pid){
-  int nNonBranch = 0;
-  static Stmt q;
-  static const char zSql[] = 
-    @ SELECT count(*) FROM plink
-    @  WHERE pid=:pid AND isprim
-    @    AND coalesce((SELECT value FROM tagxref
-    @                   WHERE tagid=%d AND rid=plink.pid), 'trunk')
-    @       =coalesce((SELECT value FROM tagxref
-    @                   WHERE tagid=%d AND rid=plink.cid), 'trunk')
-  ;
-  db_static_prepare(&q, zSql, TAG_BRANCH, TAG_BRANCH);
-  db_bind_int(&q, ":pid", pid);
-  if( db_step(&q)==SQLITE_ROW ){
-    nNonBranch = db_column_int(&q, 0);
-  }
-  db_reset(&q);
-  return nNonBranch;
+  return dag_count_nonbranch_children(dag_index(), pid);
 }
 
 
@@ -78,6 +52,7 @@ void leaf_rebuild(void){
                        " WHERE tagid=%d AND rid=plink.cid),'trunk')",
     TAG_BRANCH, TAG_BRANCH
   );
+  dag_index_reset();
 }
 
 /*
@@ -140,28 +115,62 @@ char *leaf_is_closed_sql(const char *zVar){
 
 /*
 ** Schedule a leaf check for "rid" and its parents.
+**
+** The parents are not looked up here.  leaf_do_pending_checks() finds
+** them for all scheduled check-ins at once.
+**
+** Crosslinking a new check-in inserts its PLINK rows and then schedules
+** it here, as does every change to a branch tag.  So this is also where
+** the in-memory DAG learns that it is out of date.
 */
 void leaf_eventually_check(int rid){
-  static Stmt parentsOf;
-
-  db_static_prepare(&parentsOf, 
-     "SELECT pid FROM plink WHERE cid=:rid AND pid>0"
-  );
-  db_bind_int(&parentsOf, ":rid", rid);
   bag_insert(&needToCheck, rid);
-  while( db_step(&parentsOf)==SQLITE_ROW ){
-    bag_insert(&needToCheck, db_column_int(&parentsOf, 0));
-  }
-  db_reset(&parentsOf);
+  dag_index_reset();
 }
 
 /*
 ** Do all pending leaf checks.
+**
+** The pending check-ins and their parents are loaded into a temporary
+** table, and the leaf status of all of them is then decided by a
+** single UPDATE.  This gives the same LEAF table as calling
+** leaf_check() on each one, without a separate query per check-in.
 */
 void leaf_do_pending_checks(void){
+  Stmt ins;
   int rid;
-  for(rid=bag_first(&needToCheck); rid; rid=bag_next(&needToCheck,rid)){
-    leaf_check(rid);
+  int i = 0;
+
+  if( bag_count(&needToCheck)==0 ) return;
+  db_multi_exec(
+    "CREATE TEMP TABLE IF NOT EXISTS leafcheck("
+    "  rid INTEGER PRIMARY KEY,"
+    "  isleaf BOOLEAN"
+    ");"
+    "DELETE FROM leafcheck;"
+  );
+  db_prepare(&ins, "INSERT OR IGNORE INTO leafcheck(rid) VALUES(:rid)");
+  while( (rid = bag_step(&needToCheck, &i))>0 ){
+    db_bind_int(&ins, ":rid", rid);
+    db_step(&ins);
+    db_reset(&ins);
   }
+  db_finalize(&ins);
   bag_clear(&needToCheck);
+  db_multi_exec(
+    "INSERT OR IGNORE INTO leafcheck(rid)"
+    "  SELECT pid FROM plink WHERE cid IN leafcheck AND pid>0;"
+    "UPDATE leafcheck SET isleaf = NOT EXISTS("
+    "  SELECT 1 FROM plink"
+    "   WHERE pid=leafcheck.rid"
+    "     AND coalesce((SELECT value FROM tagxref"
+                      " WHERE tagid=%d AND rid=leafcheck.rid),'trunk')"
+         " == coalesce((SELECT value FROM tagxref"
+                      " WHERE tagid=%d AND rid=plink.cid),'trunk'));"
+    "DELETE FROM leaf"
+    " WHERE rid IN (SELECT rid FROM leafcheck WHERE NOT isleaf);"
+    "INSERT OR IGNORE INTO leaf SELECT rid FROM leafcheck WHERE isleaf;"
+    "DELETE FROM leafcheck;",
+    TAG_BRANCH, TAG_BRANCH
+  );
 }
@@ -10,6 +10,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <stdlib.h> /* atexit() */
+#if defined(_WIN32)
+#  include <windows.h>
+#else
+#  include <sys/time.h>
+#endif
 
 #if INTERFACE
 #ifdef vcs_ENABLE_JSON
@@ -75,6 +80,8 @@ struct Global {
   int fQuiet;             /* True if -quiet flag is present */
   int fHttpTrace;         /* Trace outbound HTTP requests */
   int fSystemTrace;       /* Trace calls to vcs_system(), --systemtrace */
+  int fBlobStats;         /* Print blob and arena counts, --blobstats */
+  int fTiming;            /* Print time spent in startup phases, --timing */
   int fNoSync;            /* Do not do an autosync even.  --nosync */
   char *zPath;            /* Name of webpage being served */
   char *zExtra;           /* Extra path information past the webpage name */
@@ -275,11 +282,51 @@ static int name_search(
   return 1+(cnt>1);
 }
 
+/*
+** The phases of a run of the program, in order, and when each of them
+** ended.  Reported on exit by the --timing option.
+*/
+#define MX_TIMING 16
+static struct {
+  sqlite3_uint64 tStart;           /* When main() started */
+  int n;                           /* Number of phases recorded */
+  const char *azPhase[MX_TIMING];  /* Name of each phase */
+  sqlite3_uint64 aEnd[MX_TIMING];  /* When each phase ended */
+} phaseTiming;
+
+/*
+** Record that phase zPhase of the run has just ended.  Phases are always
+** recorded, since that only costs a clock read, but are only reported
+** if --timing is used.
+*/
+void vcs_timing_mark(const char *zPhase){
+  if( phaseTiming.n<MX_TIMING ){
+    phaseTiming.azPhase[phaseTiming.n] = zPhase;
+    phaseTiming.aEnd[phaseTiming.n++] = vcs_timer_now();
+  }
+}
+
+/*
+** Print the time spent in each recorded phase on stderr.
+*/
+static void timing_print(void){
+  sqlite3_uint64 t = phaseTiming.tStart;
+  int i;
+  for(i=0; i<phaseTiming.n; i++){
+    fprintf(stderr, "%-10s %10.3f ms\n",
+            phaseTiming.azPhase[i], (phaseTiming.aEnd[i]-t)/1000.0);
+    t = phaseTiming.aEnd[i];
+  }
+  fprintf(stderr, "%-10s %10.3f ms\n",
+          "total", (t-phaseTiming.tStart)/1000.0);
+}
+
 /*
 ** atexit() handler which frees up "some" of the resources
 ** used by vcs.
 */
 void vcs_atexit(void) {
+  vcs_timing_mark("command");
 #ifdef vcs_ENABLE_JSON
   cson_value_free(g.json.gc.v);
   memset(&g.json, 0, sizeof(g.json));
@@ -288,6 +335,14 @@ void vcs_atexit(void) {
   if(g.db){
     db_close(0);
   }
+  if( g.fBlobStats ){
+    blob_print_stats();
+    arena_print_stats();
+  }
+  if( g.fTiming ){
+    vcs_timing_mark("cleanup");
+    timing_print();
+  }
 }
 
 /*
@@ -379,6 +434,7 @@ int main(int argc, char **argv){
   g.tcl.interp = 0;
 #endif
 
+  phaseTiming.tStart = vcs_timer_now();
   sqlite3_config(SQLITE_CONFIG_LOG, vcs_sqlite_log, 0);
   memset(&g, 0, sizeof(g));
   g.now = time(0);
@@ -401,6 +457,7 @@ int main(int argc, char **argv){
   argc = g.argc;
   argv = g.argv;
   for(i=0; i<argc; i++) g.argv[i] = vcs_mbcs_to_utf8(argv[i]);
+  vcs_timing_mark("args");
   if( vcs_getenv("GATEWAY_INTERFACE")!=0 && !find_option("nocgi", 0, 0)){
     zCmdName = "cgi";
     g.isHTTP = 1;
@@ -418,6 +475,8 @@ int main(int argc, char **argv){
     g.fSqlTrace = find_option("sqltrace", 0, 0)!=0;
     g.fSqlStats = find_option("sqlstats", 0, 0)!=0;
     g.fSystemTrace = find_option("systemtrace", 0, 0)!=0;
+    g.fBlobStats = find_option("blobstats", 0, 0)!=0;
+    g.fTiming = find_option("timing", 0, 0)!=0;
     if( g.fSqlTrace ) g.fSqlStats = 1;
     g.fSqlPrint = find_option("sqlprint", 0, 0)!=0;
     g.fHttpTrace = find_option("httptrace", 0, 0)!=0;
@@ -440,6 +499,7 @@ int main(int argc, char **argv){
     }
     zCmdName = g.argv[1];
   }
+  vcs_timing_mark("options");
   rc = name_search(zCmdName, aCommand, count(aCommand), &idx);
   if( rc==1 ){
     vcs_fatal("%s: unknown command: %s\n"
@@ -461,6 +521,7 @@ int main(int argc, char **argv){
                  argv[0], zCmdName, argv[0], blob_str(&couldbe), argv[0]);
     vcs_exit(1);
   }
+  vcs_timing_mark("lookup");
   atexit( vcs_atexit );
   aCommand[idx].xFunc();
   vcs_exit(0);
@@ -640,6 +701,25 @@ void *vcs_realloc(void *p, size_t n){
   return p;
 }
 
+/*
+** Return a wall-clock time in microseconds.  Only differences between
+** two values are meaningful.  Used to report timings from the test-*
+** benchmark commands.
+*/
+sqlite3_uint64 vcs_timer_now(void){
+#if defined(_WIN32)
+  FILETIME ft;
+  sqlite3_uint64 t;
+  GetSystemTimeAsFileTime(&ft);
+  t = (((sqlite3_uint64)ft.dwHighDateTime)<<32) | ft.dwLowDateTime;
+  return t/10;
+#else
+  struct timeval sNow;
+  gettimeofday(&sNow, 0);
+  return ((sqlite3_uint64)sNow.tv_sec)*1000000 + sNow.tv_usec;
+#endif
+}
+
 /*
 ** This function implements a cross-platform "system()" interface.
 */
@@ -945,6 +1025,7 @@ static char *enter_chroot_jail(char *zRepo){
       if( chdir(zDir) || chroot(zDir) || chdir("/") ){
         vcs_fatal("unable to chroot into %s", zDir);
       }
+      file_name_cache_reset();
       zRepo = "/";
     }else{
       for(i=strlen(zDir)-1; i>0 && zDir[i]!='/'; i--){}
@@ -953,6 +1034,7 @@ static char *enter_chroot_jail(char *zRepo){
       if( chdir(zDir) || chroot(zDir) || chdir("/") ){
         vcs_fatal("unable to chroot into %s", zDir);
       }
+      file_name_cache_reset();
       zDir[i] = '/';
       zRepo = &zDir[i];
     }
@@ -282,8 +282,13 @@ int sha1sum_file(const char *zFilename, Blob *pCksum){
   SHA1Context ctx;
   unsigned char zResult[20];
   char zBuf[10240];
+  FileStat st;
+#if !defined(_WIN32)
+  Blob content;
+#endif
 
-  if( file_wd_islink(zFilename) ){
+  file_wd_stat(zFilename, &st);
+  if( st.perm==PERM_LNK ){
     /* Instead of file content, return sha1 of link destination path */
     Blob destinationPath;
     int rc;
@@ -294,6 +299,17 @@ int sha1sum_file(const char *zFilename, Blob *pCksum){
     return rc;
   }
 
+#if !defined(_WIN32)
+  /* Large files are hashed straight from a mapping of the file */
+  if( st.size>=BLOB_MMAP_MIN ){
+    int rc;
+    blob_map_file(&content, zFilename);
+    rc = sha1sum_blob(&content, pCksum);
+    blob_reset(&content);
+    return rc;
+  }
+#endif
+
   in = vcs_fopen(zFilename,"rb");
   if( in==0 ){
     return 1;
@@ -323,9 +339,17 @@ int sha1sum_file(const char *zFilename, Blob *pCksum){
 int sha1sum_blob(const Blob *pIn, Blob *pCksum){
   SHA1Context ctx;
   unsigned char zResult[20];
+  const unsigned char *z = (const unsigned char*)blob_buffer(pIn);
+  i64 n = blob_size(pIn);
 
   SHA1Init(&ctx);
-  SHA1Update(&ctx, (unsigned char*)blob_buffer(pIn), blob_size(pIn));
+  /* SHA1Update() takes a 32-bit length */
+  while( n>0 ){
+    unsigned int nChunk = n>0x40000000 ? 0x40000000 : (unsigned int)n;
+    SHA1Update(&ctx, z, nChunk);
+    z += nChunk;
+    n -= nChunk;
+  }
   if( pIn==pCksum ){
     blob_reset(pCksum);
   }else{
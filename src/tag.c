@@ -84,6 +84,7 @@ static void tag_propagate(
   pqueue_clear(&queue);
   db_finalize(&ins);
   db_finalize(&s);
+  if( tagid==TAG_BRANCH ) dag_index_reset();
   if( tagid==TAG_BGCOLOR ){
     db_finalize(&eventupdate);
   }
@@ -166,7 +167,10 @@ int tag_insert(
   db_bind_double(&s, ":mtime", mtime);
   db_step(&s);
   db_finalize(&s);
-  if( tagid==TAG_BRANCH ) leaf_eventually_check(rid);
+  if( tagid==TAG_BRANCH ){
+    dag_index_reset();
+    leaf_eventually_check(rid);
+  }
   if( tagtype==0 ){
     zValue = 0;
   }
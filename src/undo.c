@@ -4,6 +4,282 @@
 #include "config.h"
 #include "undo.h"
 
+/*
+** True if the undo table is in the compact format, false if it is in
+** the old format, and -1 if this has not been checked yet.
+*/
+static int undoCompact = -1;
+
+/*
+** Return true if the undo table uses the compact format.  In that format
+** a file identical to an artifact is saved as just the rid of the
+** artifact, a file edited from an artifact is saved as a delta against
+** it, and all saved content is compressed.
+**
+** Undo tables left behind by older versions have no rid column and hold
+** the full uncompressed content of every file.
+*/
+static int undo_is_compact(void){
+  if( undoCompact<0 ){
+    undoCompact = db_exists(
+      "SELECT 1 FROM %s.sqlite_master"
+      " WHERE name='undo' AND sql LIKE '%%rid INTEGER%%'",
+      db_name("localdb")
+    );
+  }
+  return undoCompact;
+}
+
+/*
+** Encode the file zFullname, named zPathname relative to the root of
+** the tree, for the compact undo table.  Return the rid of the artifact
+** that the encoding is relative to, or 0 if there is none.
+**
+** If the checkout records the file as an unchanged copy of an artifact,
+** and its size, mtime and SHA1 hash on disk agree, nothing needs to be
+** saved and pOut is left empty.  The hash is checked because the
+** chnged flag of VFILE may be stale and an edit that keeps the size
+** within the same second would not change the other two.  If the file
+** is an edited copy of an artifact,
+** pOut is a delta against that artifact.  Otherwise pOut is the full
+** content.  Either way pOut is compressed.
+*/
+static int undo_encode_file(
+  const char *zPathname,   /* Name relative to the root of the tree */
+  const char *zFullname,   /* Full name of the file on disk */
+  const FileStat *pStat,   /* What file_wd_stat() found for zFullname */
+  Blob *pOut               /* Write the encoded content here */
+){
+  static Stmt q;
+  Blob content;
+  Blob uuid;
+  int isLink = pStat->perm==PERM_LNK;
+  int rid = 0;
+  int isSame = 0;
+
+  blob_zero(pOut);
+  if( !isLink ){
+    db_static_prepare(&q,
+      "SELECT vfile.rid,"
+      "       chnged=0 AND NOT deleted AND mtime=:mtime AND blob.size=:size,"
+      "       blob.uuid"
+      "  FROM vfile JOIN blob ON blob.rid=vfile.rid"
+      " WHERE pathname=:path AND vid=:vid AND vfile.rid>0 AND NOT islink"
+    );
+    db_bind_text(&q, ":path", zPathname);
+    db_bind_int(&q, ":vid", db_lget_int("checkout", 0));
+    db_bind_int64(&q, ":mtime", pStat->mtime);
+    db_bind_int64(&q, ":size", pStat->size);
+    blob_zero(&uuid);
+    if( db_step(&q)==SQLITE_ROW ){
+      rid = db_column_int(&q, 0);
+      isSame = db_column_int(&q, 1);
+      if( isSame ) blob_append(&uuid, db_column_text(&q, 2), -1);
+    }
+    db_reset(&q);
+  }
+
+  if( isLink ){
+    blob_read_link(&content, zFullname);
+  }else{
+    blob_map_file(&content, zFullname);
+  }
+  if( isSame ){
+    Blob cksum;
+    sha1sum_blob(&content, &cksum);
+    isSame = blob_compare(&cksum, &uuid)==0;
+    blob_reset(&cksum);
+    blob_reset(&uuid);
+    if( isSame ){
+      blob_reset(&content);
+      return rid;
+    }
+  }
+  if( rid>0 ){
+    Blob orig, delta;
+    if( content_get(rid, &orig) ){
+      blob_delta_create(&orig, &content, &delta);
+      blob_compress(&delta, pOut);
+      blob_reset(&delta);
+    }else{
+      rid = 0;
+    }
+    blob_reset(&orig);
+  }
+  if( rid==0 ){
+    blob_compress(&content, pOut);
+  }
+  blob_reset(&content);
+  return rid;
+}
+
+/*
+** Rebuild in pOut the file content that undo_encode_file() encoded as
+** pStored relative to artifact rid.
+**
+** Return 0 on success.  Return 1, with pOut empty, if the artifact is
+** missing or pStored is damaged.  The caller must not write pOut to
+** disk in that case.
+*/
+static int undo_decode_file(int rid, Blob *pStored, Blob *pOut){
+  blob_zero(pOut);
+  if( rid>0 ){
+    if( !content_get(rid, pOut) ){
+      blob_reset(pOut);
+      return 1;
+    }
+    if( blob_size(pStored)>0 ){
+      Blob delta;
+      blob_zero(&delta);
+      if( blob_uncompress(pStored, &delta)
+       || blob_delta_apply(pOut, &delta, pOut)<0
+      ){
+        blob_reset(&delta);
+        blob_reset(pOut);
+        return 1;
+      }
+      blob_reset(&delta);
+    }
+  }else if( blob_size(pStored)<=4 || blob_uncompress(pStored, pOut) ){
+    /* Full content is always stored compressed, so an empty or short
+    ** value cannot be a valid encoding */
+    blob_reset(pOut);
+    return 1;
+  }
+  return 0;
+}
+
+/*
+** State shared by every file of one undo or redo operation.  The
+** statements are prepared once and reused for each file.
+*/
+typedef struct UndoCtx UndoCtx;
+struct UndoCtx {
+  int redoFlag;        /* True to redo rather than undo */
+  int isCompact;       /* True if the undo table is in the compact format */
+  Stmt qUpdate;        /* Save the current state of a file for redo */
+};
+
+/*
+** The columns of the undo table that undo_one_row() expects, in order.
+** The last is the rid, which older undo tables do not have.
+*/
+#define UNDO_COLUMNS "rowid, pathname, content, existsflag, isExe, isLink, %s"
+
+/*
+** Prepare the statements of an undo or redo operation.
+*/
+static void undo_ctx_init(UndoCtx *p, int redoFlag){
+  p->redoFlag = redoFlag;
+  p->isCompact = undo_is_compact();
+  db_prepare(&p->qUpdate,
+     "UPDATE undo SET content=:c, existsflag=:exists, isExe=:exe,"
+     "       isLink=:link, redoflag=NOT redoflag%s"
+     " WHERE rowid=:id",
+     p->isCompact ? ", rid=:rid" : ""
+  );
+}
+
+/*
+** Release the statements of an undo or redo operation.
+*/
+static void undo_ctx_finish(UndoCtx *p){
+  db_finalize(&p->qUpdate);
+}
+
+/*
+** Undo or redo the change to one file.  pRow is a statement positioned
+** on the row of the undo table for the file, with the columns listed in
+** UNDO_COLUMNS.  The current state of the file is saved in the row so
+** that the change can be redone (or undone again).
+*/
+static void undo_one_row(UndoCtx *p, Stmt *pRow){
+  int id = db_column_int(pRow, 0);
+  const char *zPathname = db_column_text(pRow, 1);
+  int old_exists = db_column_int(pRow, 3);
+  int old_exe = db_column_int(pRow, 4);
+  int old_link = db_column_int(pRow, 5);
+  int new_exists;
+  int new_exe;
+  int new_link;
+  int ridCurrent = 0;
+  Arena *pArena = arena_default();
+  ArenaMark mark = arena_mark(pArena);
+  const char *zFullname;
+  FileStat st;
+  Blob current;
+  Blob new;
+
+  zFullname = arena_mprintf(pArena, "%s/%s", g.zLocalRoot, zPathname);
+  file_wd_stat(zFullname, &st);
+  new_link = st.perm==PERM_LNK;
+  new_exists = st.size>=0;
+  if( new_exists ){
+    if( p->isCompact ){
+      ridCurrent = undo_encode_file(zPathname, zFullname, &st, &current);
+    }else if( new_link ){
+      blob_read_link(&current, zFullname);
+    }else{
+      blob_read_from_file(&current, zFullname);
+    }
+    new_exe = st.perm==PERM_EXE;
+  }else{
+    blob_zero(&current);
+    new_exe = 0;
+  }
+  blob_zero(&new);
+  if( old_exists ){
+    if( p->isCompact ){
+      Blob stored;
+      db_ephemeral_blob(pRow, 2, &stored);
+      if( undo_decode_file(db_column_int(pRow, 6), &stored, &new) ){
+        vcs_fatal("cannot rebuild the saved content of %s: "
+                  "the undo record or its artifact is damaged", zPathname);
+      }
+    }else{
+      db_ephemeral_blob(pRow, 2, &new);
+    }
+    if( new_exists ){
+      vcs_print("%s %s\n", p->redoFlag ? "REDO" : "UNDO", zPathname);
+    }else{
+      vcs_print("NEW %s\n", zPathname);
+    }
+    if( new_exists && (new_link || old_link) ){
+      file_delete(zFullname);
+    }
+    if( old_link ){
+      symlink_create(blob_str(&new), zFullname);
+    }else{
+      blob_write_to_file(&new, zFullname);
+    }
+    file_wd_setexe(zFullname, old_exe);
+  }else{
+    vcs_print("DELETE %s\n", zPathname);
+    file_delete(zFullname);
+  }
+  blob_reset(&new);
+  arena_rewind(pArena, mark);
+
+  /* The statement is reused for every file, so :c must be bound every
+  ** time.  Otherwise it would still point at the previous file's content,
+  ** which has been freed. */
+  if( new_exists && (!p->isCompact || blob_size(&current)>0) ){
+    db_bind_blob(&p->qUpdate, ":c", &current);
+  }else{
+    db_bind_null(&p->qUpdate, ":c");
+  }
+  db_bind_int(&p->qUpdate, ":exists", new_exists);
+  db_bind_int(&p->qUpdate, ":exe", new_exe);
+  db_bind_int(&p->qUpdate, ":link", new_link);
+  if( p->isCompact ){
+    db_bind_int(&p->qUpdate, ":rid", ridCurrent);
+  }
+  db_bind_int(&p->qUpdate, ":id", id);
+  db_step(&p->qUpdate);
+  db_reset(&p->qUpdate);
+  blob_reset(&current);
+}
+
 /*
 ** Undo the change to the file zPathname.  zPathname is the pathname
 ** of the file relative to the root of the repository.  If redoFlag is
@@ -11,98 +287,45 @@
 ** this routine is a noop.
 */
 static void undo_one(const char *zPathname, int redoFlag){
+  UndoCtx ctx;
   Stmt q;
-  char *zFullname;
+  undo_ctx_init(&ctx, redoFlag);
   db_prepare(&q,
-    "SELECT content, existsflag, isExe, isLink FROM undo"
+    "SELECT " UNDO_COLUMNS " FROM undo"
     " WHERE pathname=%Q AND redoflag=%d",
-     zPathname, redoFlag
+     ctx.isCompact ? "rid" : "0", zPathname, redoFlag
   );
   if( db_step(&q)==SQLITE_ROW ){
-    int old_exists;
-    int new_exists;
-    int old_exe;
-    int new_exe;
-    int new_link;
-    int old_link;
-    Blob current;
-    Blob new;
-    zFullname = mprintf("%s/%s", g.zLocalRoot, zPathname);
-    old_link = db_column_int(&q, 3);
-    new_link = file_wd_islink(zFullname);
-    new_exists = file_wd_size(zFullname)>=0;
-    if( new_exists ){
-      if( new_link ){
-        blob_read_link(&current, zFullname);
-      }else{
-        blob_read_from_file(&current, zFullname);        
-      }
-      new_exe = file_wd_isexe(zFullname);
-    }else{
-      blob_zero(&current);
-      new_exe = 0;
-    }
-    blob_zero(&new);
-    old_exists = db_column_int(&q, 1);
-    old_exe = db_column_int(&q, 2);
-    if( old_exists ){
-      db_ephemeral_blob(&q, 0, &new);
-    }
-    if( old_exists ){
-      if( new_exists ){
-        vcs_print("%s %s\n", redoFlag ? "REDO" : "UNDO", zPathname);
-      }else{
-        vcs_print("NEW %s\n", zPathname);
-      }
-      if( new_exists && (new_link || old_link) ){
-        file_delete(zFullname);
-      }
-      if( old_link ){
-        symlink_create(blob_str(&new), zFullname);
-      }else{
-        blob_write_to_file(&new, zFullname);
-      }
-      file_wd_setexe(zFullname, old_exe);
-    }else{
-      vcs_print("DELETE %s\n", zPathname);
-      file_delete(zFullname);
-    }
-    blob_reset(&new);
-    free(zFullname);
-    db_finalize(&q);
-    db_prepare(&q, 
-       "UPDATE undo SET content=:c, existsflag=%d, isExe=%d, isLink=%d,"
-             " redoflag=NOT redoflag"
-       " WHERE pathname=%Q",
-       new_exists, new_exe, new_link, zPathname
-    );
-    if( new_exists ){
-      db_bind_blob(&q, ":c", &current);
-    }
-    db_step(&q);
-    blob_reset(&current);
+    undo_one_row(&ctx, &q);
   }
   db_finalize(&q);
+  undo_ctx_finish(&ctx);
 }
 
 /*
 ** Undo or redo changes to the filesystem.  Undo the changes in the
 ** same order that they were originally carried out - undo the oldest
 ** change first and undo the most recent change last.
+**
+** All the files are streamed out of a single query in rowid order and
+** the same UPDATE statement saves the state of each for redo.  Updating
+** a row does not change its rowid, so the scan sees each row once.
 */
 static void undo_all_filesystem(int redoFlag){
+  UndoCtx ctx;
   Stmt q;
+  undo_ctx_init(&ctx, redoFlag);
   db_prepare(&q,
-     "SELECT pathname FROM undo"
+     "SELECT " UNDO_COLUMNS " FROM undo"
      " WHERE redoflag=%d"
      " ORDER BY rowid",
-     redoFlag
+     ctx.isCompact ? "rid" : "0", redoFlag
   );
   while( db_step(&q)==SQLITE_ROW ){
-    const char *zPathname = db_column_text(&q, 0);
-    undo_one(zPathname, redoFlag);
+    undo_one_row(&ctx, &q);
   }
   db_finalize(&q);
+  undo_ctx_finish(&ctx);
 }
 
 /*
@@ -159,6 +382,7 @@ void undo_reset(void){
     @ DROP TABLE IF EXISTS undo_stashfile;
     ;
   db_multi_exec(zSql);
+  undoCompact = -1;
   db_lset_int("undo_available", 0);
   db_lset_int("undo_checkout", 0);
 }
@@ -209,7 +433,8 @@ void undo_begin(void){
     @   existsflag BOOLEAN,               -- True if the file exists
     @   isExe BOOLEAN,                    -- True if the file is executable
     @   isLink BOOLEAN,                   -- True if the file is symlink
-    @   content BLOB                      -- Saved content
+    @   rid INTEGER,                      -- Artifact content is based on or 0
+    @   content BLOB                      -- Compressed content or delta
     @ );
     @ CREATE TABLE %s.undo_vfile AS SELECT * FROM vfile;
     @ CREATE TABLE %s.undo_vmerge AS SELECT * FROM vmerge;
@@ -217,6 +442,7 @@ void undo_begin(void){
   if( undoDisable ) return;
   undo_reset();
   db_multi_exec(zSql, zDb, zDb, zDb);
+  undoCompact = 1;
   cid = db_lget_int("checkout", 0);
   db_lset_int("undo_checkout", cid);
   db_lset_int("undo_available", 1);
@@ -244,38 +470,46 @@ static int undoNeedRollback = 0;
 ** Save the current content of the file zPathname so that it
 ** will be undoable.  The name is relative to the root of the
 ** tree.
+**
+** A file that is an unchanged copy of an artifact is saved as just the
+** rid of the artifact, so saving it costs no more than a row of
+** metadata.  See undo_encode_file() for the details.
 */
 void undo_save(const char *zPathname){
-  char *zFullname;
+  Arena *pArena;
+  ArenaMark mark;
+  const char *zFullname;
+  FileStat st;
   Blob content;
   int existsFlag;
-  int isLink;
+  int rid = 0;
   Stmt q;
 
   if( !undoActive ) return;
-  zFullname = mprintf("%s%s", g.zLocalRoot, zPathname);
-  existsFlag = file_wd_size(zFullname)>=0;
-  isLink = file_wd_islink(zFullname);
+  /* Only the first save of a file counts, so skip encoding it again */
+  if( db_exists("SELECT 1 FROM undo WHERE pathname=%Q", zPathname) ) return;
+  pArena = arena_default();
+  mark = arena_mark(pArena);
+  zFullname = arena_mprintf(pArena, "%s%s", g.zLocalRoot, zPathname);
+  existsFlag = file_wd_stat(zFullname, &st)==0;
   db_prepare(&q,
     "INSERT OR IGNORE INTO"
-    "   undo(pathname,redoflag,existsflag,isExe,isLink,content)"
-    " VALUES(%Q,0,%d,%d,%d,:c)",
-    zPathname, existsFlag, file_wd_isexe(zFullname), isLink
+    "   undo(pathname,redoflag,existsflag,isExe,isLink,rid,content)"
+    " VALUES(%Q,0,%d,%d,%d,:rid,:c)",
+    zPathname, existsFlag, st.perm==PERM_EXE, st.perm==PERM_LNK
   );
+  blob_zero(&content);
   if( existsFlag ){
-    if( isLink ){
-      blob_read_link(&content, zFullname); 
-    }else{
-      blob_read_from_file(&content, zFullname);
+    rid = undo_encode_file(zPathname, zFullname, &st, &content);
+    if( blob_size(&content)>0 ){
+      db_bind_blob(&q, ":c", &content);
     }
-    db_bind_blob(&q, ":c", &content);
   }
-  free(zFullname);
+  db_bind_int(&q, ":rid", rid);
+  arena_rewind(pArena, mark);
   db_step(&q);
   db_finalize(&q);
-  if( existsFlag ){
-    blob_reset(&content);
-  }
+  blob_reset(&content);
   undoNeedRollback = 1;
 }
 
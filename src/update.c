@@ -665,8 +665,10 @@ void revert_cmd(void){
       db_multi_exec("DELETE FROM vfile WHERE pathname=%Q", zFile);
     }else{
       sqlite3_int64 mtime;
+      FileStat st;
       undo_save(zFile);
-      if( file_wd_size(zFull)>=0 && (isLink || file_wd_islink(zFull)) ){
+      file_wd_stat(zFull, &st);
+      if( st.size>=0 && (isLink || st.perm==PERM_LNK) ){
         file_delete(zFull);
       }
       if( isLink ){
@@ -674,9 +676,10 @@ void revert_cmd(void){
       }else{
         blob_write_to_file(&record, zFull);
       }
-      file_wd_setexe(zFull, isExe);
+      file_wd_stat(zFull, &st);
+      file_stat_setexe(zFull, &st, isExe);
       vcs_print("REVERTED: %s\n", zFile);
-      mtime = file_wd_mtime(zFull);
+      mtime = st.mtime;
       db_multi_exec(
          "UPDATE vfile"
          "   SET mtime=%lld, chnged=0, deleted=0, isexe=%d, islink=%d,mrid=rid,"
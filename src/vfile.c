@@ -5,6 +5,9 @@
 #include "vfile.h"
 #include <assert.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #if defined(__DMC__)
 #include "dirent.h"
 #else
@@ -155,6 +158,7 @@ void vfile_check_signature(int vid, int notFileIsFatal, int useSha1sum){
     i64 currentMtime;
     i64 origSize;
     i64 currentSize;
+    FileStat st;
 
     id = db_column_int(&q, 0);
     zName = db_column_text(&q, 1);
@@ -162,13 +166,14 @@ void vfile_check_signature(int vid, int notFileIsFatal, int useSha1sum){
     isDeleted = db_column_int(&q, 3);
     oldChnged = chnged = db_column_int(&q, 4);
     oldMtime = db_column_int64(&q, 7);
-    currentSize = file_wd_size(zName);
+    file_wd_stat(zName, &st);
+    currentSize = st.size;
     origSize = db_column_int64(&q, 6);
-    currentMtime = file_wd_mtime(0);
+    currentMtime = st.mtime;
     if( chnged==0 && (isDeleted || rid==0) ){
       /* "vcs rm" or "vcs add" always change the file */
       chnged = 1;
-    }else if( !file_wd_isfile_or_link(0) && currentSize>=0 ){
+    }else if( !st.isFileOrLink && currentSize>=0 ){
       if( notFileIsFatal ){
         vcs_warning("not an ordinary file: %s", zName);
         nErr++;
@@ -246,6 +251,7 @@ void vfile_to_disk(
   while( db_step(&q)==SQLITE_ROW ){
     int id, rid, isExe, isLink;
     const char *zName;
+    FileStat st;
 
     id = db_column_int(&q, 0);
     zName = db_column_text(&q, 1);
@@ -253,15 +259,16 @@ void vfile_to_disk(
     isExe = db_column_int(&q, 3);
     isLink = db_column_int(&q, 4);
     content_get(rid, &content);
-    if( file_is_the_same(&content, zName) ){
+    file_wd_stat(zName, &st);
+    if( file_stat_is_the_same(&content, zName, &st) ){
       blob_reset(&content);
-      if( file_wd_setexe(zName, isExe) ){
+      if( file_stat_setexe(zName, &st, isExe) ){
         db_multi_exec("UPDATE vfile SET mtime=%lld WHERE id=%d",
-                      file_wd_mtime(zName), id);
+                      st.mtime, id);
       }
       continue;
     }
-    if( promptFlag && file_wd_size(zName)>=0 ){
+    if( promptFlag && st.size>=0 ){
       Blob ans;
       char *zMsg;
       char cReply;
@@ -280,11 +287,11 @@ void vfile_to_disk(
       }
     }
     if( verbose ) vcs_print("%s\n", &zName[nRepos]);
-    if( file_wd_isdir(zName) == 1 ){
+    if( st.isDir ){
       /*TODO(dchest): remove directories? */
       vcs_fatal("%s is directory, cannot overwrite\n", zName);
     }    
-    if( file_wd_size(zName)>=0 && (isLink || file_wd_islink(zName)) ){
+    if( st.size>=0 && (isLink || st.perm==PERM_LNK) ){
       file_delete(zName);
     }
     if( isLink ){
@@ -292,10 +299,11 @@ void vfile_to_disk(
     }else{
       blob_write_to_file(&content, zName);
     }
-    file_wd_setexe(zName, isExe);
+    file_wd_stat(zName, &st);
+    file_stat_setexe(zName, &st, isExe);
     blob_reset(&content);
     db_multi_exec("UPDATE vfile SET mtime=%lld WHERE id=%d",
-                  file_wd_mtime(zName), id);
+                  st.mtime, id);
   }
   db_finalize(&q);
 }
@@ -335,29 +343,165 @@ int vfile_top_of_checkout(const char *zPath){
     fileFound = file_size(zFile)>=1024;
     vcs_free(zFile);
   }
+  return fileFound;
+}
 
+#if INTERFACE
 /*
-** Load into table SFILE the name of every ordinary file in
-** the directory pPath.   Omit the first nPrefix characters of
-** of pPath when inserting into the SFILE table.
-**
-** Subdirectories are scanned recursively.
-** Omit files named in VFILE.
-**
-** Files whose names begin with "." are omitted unless allFlag is true.
+** Values for the scanFlags parameter to vfile_scan().
+*/
+#define SCAN_ALL    0x001    /* Include files whose names begin with "." */
+#define SCAN_PERM   0x002    /* Record the PERM_* of each file in SFILE.PERM */
+#endif
+
+/*
+** Names of files found by vfile_scan(), each followed by a zero byte.
+** They are moved into SFILE all at once by vfile_scan_flush().
+*/
+typedef struct ScanNames ScanNames;
+struct ScanNames {
+  Blob aName;          /* Zero-terminated names, back to back */
+  Blob aPerm;          /* One PERM_* byte per name if SCAN_PERM */
+  int nName;           /* Number of names in aName */
+  unsigned scanFlags;  /* SCAN_* flags passed to vfile_scan() */
+};
+
+/*
+** Append the name zPath of a file with permission perm to p.
+*/
+static void vfile_scan_add(ScanNames *p, const char *zPath, int perm){
+  blob_append(&p->aName, zPath, strlen(zPath)+1);
+  if( p->scanFlags & SCAN_PERM ){
+    char c = (char)perm;
+    blob_append(&p->aPerm, &c, 1);
+  }
+  p->nName++;
+}
+
+#if !defined(_WIN32) && defined(DT_DIR)
+/*
+** Like vfile_top_of_checkout() but for the directory zName relative to
+** the open directory dirFd.
+*/
+static int vfile_fd_top_of_checkout(int dirFd, const char *zName){
+  static const char *azDb[] = { "_vcs_", ".fslckout" };
+  struct stat st;
+  char zBuf[4096];
+  int i;
+  for(i=0; i<(int)count(azDb); i++){
+    sqlite3_snprintf(sizeof(zBuf), zBuf, "%s/%s", zName, azDb[i]);
+    if( fstatat(dirFd, zBuf, &st, 0)==0 && st.st_size>=1024 ) return 1;
+  }
+  return 0;
+}
+
+/*
+** Walk the directory open on dirFd, whose full name is in pPath, and
+** append every ordinary file to p.  dirFd is closed before returning.
 **
-** Any files or directories that match the glob pattern pIgnore are 
-** excluded from the scan.  Name matching occurs after the first
-** nPrefix characters are elided from the filename.
+** The directory entry type is used to tell files from directories
+** wherever the filesystem reports it, so most entries cost no stat()
+** at all.  Subdirectories are opened and the rest stat-ed relative to
+** their parent with openat() and fstatat(), so the kernel does not
+** resolve the full path again for every entry.
+*/
+static void vfile_scan_fd(
+  int dirFd,           /* Open directory to walk */
+  Blob *pPath,         /* Full name of the directory */
+  int nPrefix,         /* Characters of pPath to omit from names */
+  Glob *pIgnore,       /* Skip names matching this */
+  ScanNames *p         /* Append names here */
+){
+  DIR *d;
+  struct dirent *pEntry;
+  int statFlags = g.allowSymlinks ? AT_SYMLINK_NOFOLLOW : 0;
+  int origSize = blob_size(pPath);
+
+  d = fdopendir(dirFd);
+  if( d==0 ){
+    close(dirFd);
+    return;
+  }
+  while( (pEntry=readdir(d))!=0 ){
+    const char *zName = pEntry->d_name;
+    char *zPath;
+    char *zUtf8;
+    struct stat st;
+    int haveStat = 0;
+    int isDir = 0;
+    int isFile = 0;
+    if( zName[0]=='.' ){
+      if( (p->scanFlags & SCAN_ALL)==0 ) continue;
+      if( zName[1]==0 ) continue;
+      if( zName[1]=='.' && zName[2]==0 ) continue;
+    }
+    zUtf8 = vcs_mbcs_to_utf8(zName);
+    blob_append(pPath, "/", 1);
+    blob_append(pPath, zUtf8, -1);
+    vcs_mbcs_free(zUtf8);
+    zPath = blob_str(pPath);
+    if( glob_match(pIgnore, &zPath[nPrefix+1]) ){
+      blob_resize(pPath, origSize);
+      continue;
+    }
+    if( pEntry->d_type==DT_DIR ){
+      isDir = 1;
+    }else if( pEntry->d_type==DT_REG ){
+      isFile = 1;
+    }else if( pEntry->d_type==DT_LNK && g.allowSymlinks ){
+      isFile = 1;
+    }else if( pEntry->d_type==DT_LNK || pEntry->d_type==DT_UNKNOWN ){
+      /* Same stat() or lstat() choice as file_wd_isdir() */
+      if( fstatat(dirfd(d), zName, &st, statFlags)==0 ){
+        haveStat = 1;
+        isDir = S_ISDIR(st.st_mode);
+        isFile = S_ISREG(st.st_mode) || S_ISLNK(st.st_mode);
+      }
+    }
+    if( isDir ){
+      int subFd;
+      blob_append(pPath, "/", 1);
+      if( !glob_match(pIgnore, &blob_str(pPath)[nPrefix+1])
+       && !vfile_fd_top_of_checkout(dirfd(d), zName)
+       && (subFd = openat(dirfd(d), zName, O_RDONLY|O_DIRECTORY))>=0
+      ){
+        blob_resize(pPath, blob_size(pPath)-1);
+        vfile_scan_fd(subFd, pPath, nPrefix, pIgnore, p);
+      }
+    }else if( isFile ){
+      int perm = PERM_REG;
+      if( p->scanFlags & SCAN_PERM ){
+        /* Only an executable bit is left to learn for a plain file, and
+        ** it costs one fstatat() here rather than two stat() of the
+        ** full name later. */
+        if( !haveStat ){
+          haveStat = fstatat(dirfd(d), zName, &st, statFlags)==0;
+        }
+        if( haveStat ) perm = file_mode_perm(st.st_mode);
+      }
+      vfile_scan_add(p, &zPath[nPrefix+1], perm);
+    }
+    blob_resize(pPath, origSize);
+  }
+  closedir(d);
+}
+#else
+/*
+** Walk directory pPath with opendir() and readdir(), appending every
+** ordinary file to p.  Used where the fd-relative calls or the
+** directory entry type are not available.
 */
-void vfile_scan(Blob *pPath, int nPrefix, int allFlag, Glob *pIgnore){
+static void vfile_scan_dir(
+  Blob *pPath,         /* Directory to walk */
+  int nPrefix,         /* Characters of pPath to omit from names */
+  Glob *pIgnore,       /* Skip names matching this */
+  ScanNames *p         /* Append names here */
+){
   DIR *d;
   int origSize;
   const char *zDir;
   struct dirent *pEntry;
   int skipAll = 0;
-  static Stmt ins;
-  static int depth = 0;
   char *zMbcs;
 
   origSize = blob_size(pPath);
@@ -368,14 +512,6 @@ void vfile_scan(Blob *pPath, int nPrefix, int allFlag, Glob *pIgnore){
   }
   if( skipAll ) return;
 
-  if( depth==0 ){
-    db_prepare(&ins,
-       "INSERT OR IGNORE INTO sfile(x) SELECT :file"
-       "  WHERE NOT EXISTS(SELECT 1 FROM vfile WHERE pathname=:file)"
-    );
-  }
-  depth++;
-
   zDir = blob_str(pPath);
   zMbcs = vcs_utf8_to_mbcs(zDir);
   d = opendir(zMbcs);
@@ -384,7 +520,7 @@ void vfile_scan(Blob *pPath, int nPrefix, int allFlag, Glob *pIgnore){
       char *zPath;
       char *zUtf8;
       if( pEntry->d_name[0]=='.' ){
-        if( !allFlag ) continue;
+        if( (p->scanFlags & SCAN_ALL)==0 ) continue;
         if( pEntry->d_name[1]==0 ) continue;
         if( pEntry->d_name[1]=='.' && pEntry->d_name[2]==0 ) continue;
       }
@@ -396,23 +532,105 @@ void vfile_scan(Blob *pPath, int nPrefix, int allFlag, Glob *pIgnore){
         /* do nothing */
       }else if( file_wd_isdir(zPath)==1 ){
         if( !vfile_top_of_checkout(zPath) ){
-          vfile_scan(pPath, nPrefix, allFlag, pIgnore);
+          vfile_scan_dir(pPath, nPrefix, pIgnore, p);
         }
       }else if( file_wd_isfile_or_link(zPath) ){
-        db_bind_text(&ins, ":file", &zPath[nPrefix+1]);
-        db_step(&ins);
-        db_reset(&ins);
+        /* file_wd_perm(0) reuses the stat() just made */
+        int perm = (p->scanFlags & SCAN_PERM) ? file_wd_perm(0) : PERM_REG;
+        vfile_scan_add(p, &zPath[nPrefix+1], perm);
       }
       blob_resize(pPath, origSize);
     }
     closedir(d);
   }
   vcs_mbcs_free(zMbcs);
+}
+#endif
+
+/*
+** Move the names collected in p into SFILE, skipping any that are
+** already in VFILE.  The names are staged in a temporary table with one
+** cheap insert each, then merged by a single INSERT ... SELECT.
+**
+** With SCAN_PERM the permission of each file goes into SFILE.PERM,
+** which the caller must have created.
+*/
+static void vfile_scan_flush(ScanNames *p){
+  Stmt ins;
+  const char *z = blob_buffer(&p->aName);
+  const char *zPerm = blob_buffer(&p->aPerm);
+  int withPerm = (p->scanFlags & SCAN_PERM)!=0;
+  int i;
+
+  if( p->nName==0 ) return;
+  db_multi_exec("CREATE TEMP TABLE IF NOT EXISTS sfilescan(x TEXT, perm INT)");
+  db_prepare(&ins, "INSERT INTO sfilescan(x,perm) VALUES(:file,:perm)");
+  for(i=0; i<p->nName; i++){
+    db_bind_text(&ins, ":file", z);
+    db_bind_int(&ins, ":perm", withPerm ? zPerm[i] : PERM_REG);
+    db_step(&ins);
+    db_reset(&ins);
+    z += strlen(z)+1;
+  }
+  db_finalize(&ins);
+  if( withPerm ){
+    db_multi_exec(
+      "INSERT OR IGNORE INTO sfile(x,perm)"
+      "  SELECT x, perm FROM sfilescan"
+      "   WHERE x NOT IN (SELECT pathname FROM vfile);"
+    );
+  }else{
+    db_multi_exec(
+      "INSERT OR IGNORE INTO sfile(x)"
+      "  SELECT x FROM sfilescan WHERE x NOT IN (SELECT pathname FROM vfile);"
+    );
+  }
+  db_multi_exec("DELETE FROM sfilescan;");
+}
 
-  depth--;
-  if( depth==0 ){
-    db_finalize(&ins);
+/*
+** Load into table SFILE the name of every ordinary file in
+** the directory pPath.   Omit the first nPrefix characters of
+** of pPath when inserting into the SFILE table.
+**
+** Subdirectories are scanned recursively.
+** Omit files named in VFILE.
+**
+** Files whose names begin with "." are omitted unless scanFlags
+** contains SCAN_ALL.  With SCAN_PERM the PERM_* value of every file
+** is stored in the PERM column of SFILE, taken from the stat() data
+** the walk already needed.
+**
+** Any files or directories that match the glob pattern pIgnore are 
+** excluded from the scan.  Name matching occurs after the first
+** nPrefix characters are elided from the filename.
+*/
+void vfile_scan(Blob *pPath, int nPrefix, unsigned scanFlags, Glob *pIgnore){
+  ScanNames names;
+
+  memset(&names, 0, sizeof(names));
+  blob_zero(&names.aName);
+  blob_zero(&names.aPerm);
+  names.scanFlags = scanFlags;
+#if !defined(_WIN32) && defined(DT_DIR)
+  {
+    int origSize = blob_size(pPath);
+    int fd;
+    blob_append(pPath, "/", 1);
+    if( glob_match(pIgnore, &blob_str(pPath)[nPrefix+1]) ){
+      blob_resize(pPath, origSize);
+      return;
+    }
+    blob_resize(pPath, origSize);
+    fd = open(blob_str(pPath), O_RDONLY|O_DIRECTORY);
+    if( fd>=0 ) vfile_scan_fd(fd, pPath, nPrefix, pIgnore, &names);
   }
+#else
+  vfile_scan_dir(pPath, nPrefix, pIgnore, &names);
+#endif
+  vfile_scan_flush(&names);
+  blob_reset(&names.aName);
+  blob_reset(&names.aPerm);
 }
 
 /*
@@ -496,7 +714,7 @@ void vfile_aggregate_checksum_disk(int vid, Blob *pOut){
         md5sum_step_text(zName, -1);
         blob_zero(&file);
         content_get(rid, &file);
-        sqlite3_snprintf(sizeof(zBuf), zBuf, " %d\n", blob_size(&file));
+        sqlite3_snprintf(sizeof(zBuf), zBuf, " %lld\n", blob_size(&file));
         md5sum_step_text(zBuf, -1);
         md5sum_step_blob(&file);
         blob_reset(&file);
@@ -532,7 +750,7 @@ void vfile_compare_repository_to_disk(int vid){
     if( file_wd_islink(zFullpath) ){
       rc = blob_read_link(&disk, zFullpath);
     }else{
-      rc = blob_read_from_file(&disk, zFullpath);
+      rc = blob_map_file(&disk, zFullpath);
     }
     if( rc<0 ){
       vcs_print("ERROR: cannot read file [%s]\n", zFullpath);
@@ -542,8 +760,8 @@ void vfile_compare_repository_to_disk(int vid){
     blob_zero(&repo);
     content_get(rid, &repo);
     if( blob_size(&repo)!=blob_size(&disk) ){
-      vcs_print("ERROR: [%s] is %d bytes on disk but %d in the repository\n",
-             zName, blob_size(&disk), blob_size(&repo));
+      vcs_print("ERROR: [%s] is %lld bytes on disk but %lld in the "
+             "repository\n", zName, blob_size(&disk), blob_size(&repo));
       blob_reset(&disk);
       blob_reset(&repo);
       continue;
@@ -589,7 +807,7 @@ void vfile_aggregate_checksum_repository(int vid, Blob *pOut){
     if( zOrigName && !isSelected ) zName = zOrigName;
     md5sum_step_text(zName, -1);
     content_get(rid, &file);
-    sqlite3_snprintf(sizeof(zBuf), zBuf, " %d\n", blob_size(&file));
+    sqlite3_snprintf(sizeof(zBuf), zBuf, " %lld\n", blob_size(&file));
     md5sum_step_text(zBuf, -1);
     /*printf("%s %s %s",md5sum_current_state(),zName,zBuf); fflush(stdout);*/
     md5sum_step_blob(&file);
@@ -634,7 +852,7 @@ void vfile_aggregate_checksum_manifest(int vid, Blob *pOut, Blob *pManOut){
     fid = uuid_to_rid(pFile->zUuid, 0);
     md5sum_step_text(pFile->zName, -1);
     content_get(fid, &file);
-    sqlite3_snprintf(sizeof(zBuf), zBuf, " %d\n", blob_size(&file));
+    sqlite3_snprintf(sizeof(zBuf), zBuf, " %lld\n", blob_size(&file));
     md5sum_step_text(zBuf, -1);
     md5sum_step_blob(&file);
     blob_reset(&file);